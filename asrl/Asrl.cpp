@@ -39,7 +39,7 @@ void Asrl::notice()
 }
 
 
-Asrl::Asrl(Input &input, fp lambda, fp lambdaGroup, bool taperShrinkage, fp tolerance) : bT_(input.bT), lambda_(lambda), lambdaGroup_(lambdaGroup), lambdaGroupStart_(lambdaGroup), taperShrinkage_(taperShrinkage), tolerance_(tolerance), iteration_(0)
+Asrl::Asrl(Input &input, fp lambda, fp lambdaGroup, bool taperShrinkage, fp tolerance, bool preserveAcceleration, ii freezeInterval) : bT_(input.bT), lambda_(lambda), lambdaGroup_(lambdaGroup), lambdaGroupStart_(lambdaGroup), taperShrinkage_(taperShrinkage), tolerance_(tolerance), iteration_(0)
 {
     if (getDebugLevel() % 10 >= 1)
     {
@@ -50,8 +50,13 @@ Asrl::Asrl(Input &input, fp lambda, fp lambdaGroup, bool taperShrinkage, fp tole
 
     new BasisMatrix(bases_, input.aT, input.gT.size() > 0 ? &input.gT : 0, false);
 
-    innerOptimizer_ = new OptimizerSrl(bases_, bT_);
-    optimizer_ = new OptimizerAccelerationEve1(innerOptimizer_);
+    // each row of bT has its own row of xT, so rows that have converged can be left alone
+    OptimizerSrl* optimizerSrl = new OptimizerSrl(bases_, bT_);
+    optimizerSrl->setFreezing(tolerance_, freezeInterval);
+    innerOptimizer_ = optimizerSrl;
+    OptimizerAcceleration* optimizer = new OptimizerAccelerationEve1(innerOptimizer_);
+    optimizer->setPreserveState(preserveAcceleration);
+    optimizer_ = optimizer;
     optimizer_->setLambda(fp(lambda_), fp(lambdaGroup_));
 }
 
@@ -50,7 +50,8 @@ public:
         std::vector<MatrixSparse> xTgT; // transpose of Gx
     };
 
-    Asrl(Input &input, fp lambda, fp lambdaGroup, bool taperShrinkage, fp tolerance);
+    Asrl(Input &input, fp lambda, fp lambdaGroup, bool taperShrinkage, fp tolerance, bool preserveAcceleration = false,
+         ii freezeInterval = 0);
     virtual ~Asrl();
 
     bool step();
@@ -62,6 +62,23 @@ void Basis::synthesizeGroups(std::vector<MatrixSparse> &g, const vector<MatrixSp
 }
 
 
+void Basis::synthesizeObservations(std::vector<MatrixSparse> &f, const vector<MatrixSparse> &x, bool accumulate, const vector<char>* observations)
+{
+    synthesize(f, x, accumulate);
+}
+
+
+bool Basis::analyzeNorms(vector<MatrixSparse> &l1s, vector<MatrixSparse> &l2Sqrs, const vector<MatrixSparse> &fL1s, const vector<MatrixSparse> &fL2Sqrs)
+{
+    if (getParentIndex() < 0)
+        return false;
+
+    analyze(l1s, fL1s, false);
+    analyze(l2Sqrs, fL2Sqrs, true);
+    return true;
+}
+
+
 int Basis::getIndex() const
 {
     return index_;
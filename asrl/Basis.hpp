@@ -39,7 +39,9 @@ public:
     virtual void analyze(std::vector<MatrixSparse> &xE, const std::vector<MatrixSparse> &fE, bool sqrA) = 0;
 
     virtual void synthesizeGroups(std::vector<MatrixSparse> &g, const std::vector<MatrixSparse> &x, bool accumulate);
+    virtual void synthesizeObservations(std::vector<MatrixSparse> &f, const std::vector<MatrixSparse> &x, bool accumulate, const std::vector<char>* observations); // as synthesize, but only the rows of f with observations set are needed, counting through the rows of each f[k] in turn (all if 0)
     virtual std::vector<MatrixSparse> * getGroups(bool transpose) const;
+    virtual bool analyzeNorms(std::vector<MatrixSparse> &l1s, std::vector<MatrixSparse> &l2Sqrs, const std::vector<MatrixSparse> &fL1s, const std::vector<MatrixSparse> &fL2Sqrs); // as analyze of all ones without and with sqrA, given the parent's results; false if a root can't do this without ones
 
     int getIndex() const;
     int getParentIndex() const;
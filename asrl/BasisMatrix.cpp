@@ -22,6 +22,7 @@
 
 #include "BasisMatrix.hpp"
 #include <kernel.hpp>
+#include <algorithm>
 using namespace std;
 using namespace kernel;
 
@@ -94,6 +95,37 @@ void BasisMatrix::synthesize(vector<MatrixSparse> &f, const vector<MatrixSparse>
 }
 
 
+void BasisMatrix::synthesizeObservations(vector<MatrixSparse> &f, const vector<MatrixSparse> &x, bool accumulate, const vector<char>* observations)
+{
+    if (!observations)
+    {
+        synthesize(f, x, accumulate);
+        return;
+    }
+
+    if (getDebugLevel() % 10 >= 3)
+        cout << getTimeStamp() << "      BasisMatrix::synthesise " << ii(count(observations->begin(), observations->end(), 1)) << " of " << observations->size() << " observations" << endl;
+
+    if (!f.size())
+        f.resize(x.size());
+
+    // each row of x synthesises the same row of f, so the rows not needed are left out of x
+    ii i0 = 0;
+    for (ii k = 0; k < ii(as_.size()); k++)
+    {
+        vector<char> rows(observations->begin() + i0, observations->begin() + i0 + x[k].m());
+        i0 += x[k].m();
+
+        MatrixSparse t;
+        t.copyRows(x[k], rows);
+        f[k].matmul(false, t, aTs_[k], accumulate);
+    }
+
+    if (getDebugLevel() % 10 >= 3)
+        cout << getTimeStamp() << "       " << f[0] << endl;
+}
+
+
 void BasisMatrix::analyze(vector<MatrixSparse> &xE, const vector<MatrixSparse> &fE, bool sqrA)
 {
     if (getDebugLevel() % 10 >= 3)
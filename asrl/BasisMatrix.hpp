@@ -36,6 +36,8 @@ public:
     virtual void synthesize(std::vector<MatrixSparse> &f, const std::vector<MatrixSparse> &x, bool accumulate);
     virtual void analyze(std::vector<MatrixSparse> &xE, const std::vector<MatrixSparse> &fE, bool sqrA = false);
 
+    virtual void synthesizeObservations(std::vector<MatrixSparse> &f, const std::vector<MatrixSparse> &x, bool accumulate, const std::vector<char>* observations);
+
     virtual std::vector<MatrixSparse> * getGroups(bool transpose) const;
 
 private:
@@ -0,0 +1,152 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#include "OptimizerAcceleration.hpp"
+#include "OptimizerAccelerationEve1.hpp"
+#include "OptimizerAccelerationEve2.hpp"
+#include "OptimizerAccelerationMomentum.hpp"
+#include <kernel.hpp>
+#include <iomanip>
+using namespace std;
+using namespace kernel;
+
+
+OptimizerAcceleration* OptimizerAcceleration::create(Type type, Optimizer* optimizer, MatrixSparse::Precision precision)
+{
+    switch (type)
+    {
+    case Type::Eve1:
+        return new OptimizerAccelerationEve1(optimizer, precision);
+    case Type::Eve2:
+        return new OptimizerAccelerationEve2(optimizer, precision);
+    case Type::Momentum:
+        return new OptimizerAccelerationMomentum(optimizer, precision);
+    }
+
+    throw runtime_error("BUG: unknown acceleration type");
+}
+
+
+OptimizerAcceleration::OptimizerAcceleration(Optimizer* optimizer, MatrixSparse::Precision precision) : optimizer_(optimizer), precision_(precision), iteration_(0), lambdaChanged_(false), preserveState_(false), accelerationDuration_(0.0)
+{
+}
+
+
+OptimizerAcceleration::~OptimizerAcceleration()
+{
+}
+
+
+void OptimizerAcceleration::setLambda(fp lambda, fp lambdaGroup)
+{
+    if (preserveState_)
+        lambdaChanged_ = iteration_ > 0;
+    else
+        iteration_ = 0;
+
+    optimizer_->setLambda(lambda, lambdaGroup);
+}
+
+
+void OptimizerAcceleration::setPreserveState(bool preserveState)
+{
+    preserveState_ = preserveState;
+}
+
+
+fp OptimizerAcceleration::step()
+{
+    if (getDebugLevel() % 10 >= 3)
+        cout << getTimeStamp() << "    Acceleration ..." << endl;
+
+    double accelerationStart = getElapsedTime();
+    fp a = accelerate();
+    iteration_++;
+    lambdaChanged_ = false;
+    double accelerationDuration = getElapsedTime() - accelerationStart;
+
+    if (getDebugLevel() % 10 >= 3)
+        cout << getTimeStamp() << fixed << setprecision(4) <<  "    acceleration       = " << a << endl;
+
+    if (getDebugLevel() % 10 >= 2 && getElapsedTime() != 0.0)
+    {
+        accelerationDuration_ += accelerationDuration;
+
+        cout << getTimeStamp()  << "    duration_acceleration = " << fixed << setprecision(6) << setw(12) << accelerationDuration << "  total = " << setprecision(4) << setw(12) << accelerationDuration_ << endl;
+    }
+
+    // now perform the optimizer iteration on the extrapolated 'xs'
+    return optimizer_->step();
+}
+
+
+void OptimizerAcceleration::synthesize(vector<MatrixSparse>& f, vector< vector<MatrixSparse> >& xEs, ii basis)
+{
+    optimizer_->synthesize(f, xEs, basis);
+}
+
+
+void OptimizerAcceleration::analyze(std::vector< std::vector<MatrixSparse> > &xEs, std::vector<MatrixSparse> &fE, bool l2, bool l2Normalize) const
+{
+    optimizer_->analyze(xEs, fE, l2, l2Normalize);
+}
+
+
+ii OptimizerAcceleration::getIteration() const
+{
+    return optimizer_->getIteration();
+}
+
+
+const std::vector<Basis*>& OptimizerAcceleration::getBases() const
+{
+    return optimizer_->getBases();
+}
+
+
+std::vector< std::vector<MatrixSparse> >& OptimizerAcceleration::xs()
+{
+    return optimizer_->xs();
+}
+
+
+std::vector< std::vector<MatrixSparse> >& OptimizerAcceleration::l2s()
+{
+    return optimizer_->l2s();
+}
+
+
+std::vector< std::vector<MatrixSparse> >& OptimizerAcceleration::l1l2s()
+{
+    return optimizer_->l1l2s();
+}
+
+
+const fp* OptimizerAcceleration::values(const MatrixSparse& a, MatrixSparse& t) const
+{
+    if (a.getPrecision() == MatrixSparse::Precision::Single)
+        return a.vs();
+
+    t.copy(a);
+    return t.vs();
+}
@@ -0,0 +1,77 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#ifndef SEAMASS_ASRL_OPTIMIZERACCELERATION_HPP
+#define SEAMASS_ASRL_OPTIMIZERACCELERATION_HPP
+
+
+#include "Optimizer.hpp"
+
+
+/**
+* OptimizerAcceleration is the base of Optimizers that accelerate a wrapped Optimizer by adjusting its xs before each
+* of its iterations. Subclasses implement accelerate(), everything else is passed through to the wrapped Optimizer.
+*
+* The wrapped Optimizer restarts its iteration count whenever lambda changes, and by default so does the acceleration.
+* If the state is preserved instead, subclasses should fall back to a restart should the history prove unusable.
+*/
+class OptimizerAcceleration : public Optimizer
+{
+public:
+    enum class Type { Eve1, Eve2, Momentum };
+
+    static OptimizerAcceleration* create(Type type, Optimizer* optimizer, MatrixSparse::Precision precision = MatrixSparse::Precision::Single);
+
+    OptimizerAcceleration(Optimizer* optimizer, MatrixSparse::Precision precision = MatrixSparse::Precision::Single);
+    virtual ~OptimizerAcceleration();
+
+    virtual void setLambda(fp lambda, fp lambdaGroup = fp(0.0)); // restarts the acceleration unless preserving its state
+    void setPreserveState(bool preserveState); // keep acceleration history through lambda changes rather than restarting
+    virtual const std::vector<Basis*>& getBases() const;
+    virtual ii getIteration() const;
+
+    virtual fp step();
+
+    virtual void synthesize(std::vector<MatrixSparse>& f, std::vector< std::vector<MatrixSparse> >& xEs, ii basis = -1);
+    virtual void analyze(std::vector< std::vector<MatrixSparse> > &xEs, std::vector<MatrixSparse> &fE, bool l2, bool l2Normalize = true) const;
+
+    std::vector< std::vector<MatrixSparse> >& xs();
+    std::vector< std::vector<MatrixSparse> >& l2s();
+    std::vector< std::vector<MatrixSparse> >& l1l2s();
+
+protected:
+    virtual fp accelerate() = 0; // adjust xs() in place (keeping its pattern) before the next iteration, returns the acceleration parameter used
+    const fp* values(const MatrixSparse& a, MatrixSparse& t) const; // a's values as fp, converted into t if stored in 16 bit
+
+    Optimizer* optimizer_;
+    MatrixSparse::Precision precision_; // storage precision of any state kept between iterations
+    ii iteration_; // number of accelerate() calls since the last restart, set to 0 to restart from the next
+    bool lambdaChanged_; // true if lambda has changed since the last accelerate() and the state was preserved
+
+private:
+    bool preserveState_;
+    double accelerationDuration_;
+};
+
+
+#endif
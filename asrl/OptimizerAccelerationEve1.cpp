@@ -29,7 +29,7 @@ using namespace std;
 using namespace kernel;
 
 
-OptimizerAccelerationEve1::OptimizerAccelerationEve1(Optimizer* optimizer) : optimizer_(optimizer), accelerationDuration_(0.0)
+OptimizerAccelerationEve1::OptimizerAccelerationEve1(Optimizer* optimizer, MatrixSparse::Precision precision) : OptimizerAcceleration(optimizer, precision)
 {
     if (getDebugLevel() % 10 >= 1)
         cout << getTimeStamp() << "  Initialising Biggs-Andrews Acceleration (EVE1) ..." << endl;
@@ -52,266 +52,157 @@ OptimizerAccelerationEve1::~OptimizerAccelerationEve1()
 }
 
 
-void OptimizerAccelerationEve1::setLambda(fp lambda, fp lambdaGroup)
+fp OptimizerAccelerationEve1::accelerate()
 {
-    optimizer_->setLambda(lambda, lambdaGroup);
-}
-
-
-fp OptimizerAccelerationEve1::step()
-{
-    if (getDebugLevel() % 10 >= 3)
-        cout << getTimeStamp() << "    Acceleration ..." << endl;
-
     fp a = 0.0;
 
-    double accelerationStart = getElapsedTime();
+    if (iteration_ >= 2)
     {
-        if (getIteration() == 0)
+        // calculate acceleration parameter 'a'
+        double numerator = 0.0;
+        double denominator = 0.0;
+        for (ii l = 0; l < ii(getBases().size()); l++)
         {
-            for (ii l = 0; l < (ii)getBases().size(); l++)
+            if (!getBases()[l]->isTransient())
             {
-                if (!getBases()[l]->isTransient())
+                if (getDebugLevel() % 10 >= 3)
                 {
-                    if (getDebugLevel() % 10 >= 3)
-                    {
-                        ostringstream oss;
-                        oss << getTimeStamp() << "     " << l << " OptimizerAccelerationEve1::acceleration0";
-                        info(oss.str());
-                    }
+                    ostringstream oss;
+                    oss << getTimeStamp() << "     " << l << " OptimizerAccelerationEve1::accelerationCalcA";
+                    info(oss.str());
+                }
 
-                    // no extrapolation this iteration, just save 'xs'
-                    for (ii k = 0; k < ii(xs()[l].size()); k++)
-                        y0s_[l][k].copy(xs()[l][k]);
+                for (ii k = 0; k < ii(xs()[l].size()); k++)
+                {
+                    // using old gradient vector 'u0s'
+                    MatrixSparse cLogU0;
+                    cLogU0.lnNonzeros(u0s_[l][k]);
+                    cLogU0.mul(x0s_[l][k]); // (x[k-1] . log u[k-2])
+                    denominator += cLogU0.sumSqrs();  // (x[k-1] . log u[k-2]) T (x[k-1] . log u[k-2])
+
+                    // update to new gradient vector 'u0s'
+                    MatrixSparse t;
+                    t.copySubset(y0s_[l][k], xs()[l][k]);
+                    u0s_[l][k].divNonzeros(xs()[l][k], t);
+
+                    t.copySubset(cLogU0, xs()[l][k]);
+
+                    // using new gradient vector 'u0s'
+                    MatrixSparse c1LogU;
+                    c1LogU.lnNonzeros(u0s_[l][k]);
+                    c1LogU.mul(xs()[l][k]); // (x[k] . log u[k-1])
+                    c1LogU.mul(t); // (x[k] . log u[k-1]) . (x[k-1] . log u[k-2])
+                    numerator += c1LogU.sum(); // (x[k] . log u[k-1]) T (x[k-1] . log u[k-2])
+
+                    u0s_[l][k].setPrecision(precision_);
                 }
             }
         }
-        else if (getIteration() == 1)
+        a = fp(numerator / denominator);
+
+        // if the history was preserved through a change of lambda but no longer extrapolates, restart
+        if (lambdaChanged_ && !(a > 0.0f && a < 1.0f))
         {
-            for (ii l = 0; l < (ii)getBases().size(); l++)
-            {
-                if (!getBases()[l]->isTransient())
-                {
-                    for (ii k = 0; k < ii(xs()[l].size()); k++)
-                    {
-                        if (getDebugLevel() % 10 >= 3)
-                        {
-                            ostringstream oss;
-                            oss << getTimeStamp() << "     " << l << " OptimizerAccelerationEve1::acceleration1";
-                            info(oss.str());
-                        }
-                        // can now calcaulte first gradient vector 'u0s'
-                        MatrixSparse t;
-                        t.copySubset(y0s_[l][k], xs()[l][k]);
+            if (getDebugLevel() % 10 >= 3)
+                cout << getTimeStamp() << "     OptimizerAccelerationEve1::restart" << endl;
 
-                        u0s_[l][k].divNonzeros(xs()[l][k], t);
-                        // no extrapolation this iteration, just save 'xs'
-                        x0s_[l][k].copy(xs()[l][k]);
-                        y0s_[l][k].copy(xs()[l][k]);
-                    }
-                }
-            }
+            a = 0.0;
+            iteration_ = 0;
         }
-        else
+    }
+
+    if (iteration_ == 0)
+    {
+        for (ii l = 0; l < (ii)getBases().size(); l++)
         {
-            // calculate acceleration parameter 'a'
-            double numerator = 0.0;
-            double denominator = 0.0;
-            for (ii l = 0; l < ii(getBases().size()); l++)
+            if (!getBases()[l]->isTransient())
             {
-                if (!getBases()[l]->isTransient())
+                if (getDebugLevel() % 10 >= 3)
                 {
-                    if (getDebugLevel() % 10 >= 3)
-                    {
-                        ostringstream oss;
-                        oss << getTimeStamp() << "     " << l << " OptimizerAccelerationEve1::accelerationCalcA";
-                        info(oss.str());
-                    }
-
-                    for (ii k = 0; k < ii(xs()[l].size()); k++)
-                    {
-                        // using old gradient vector 'u0s'
-                        MatrixSparse cLogU0;
-                        cLogU0.lnNonzeros(u0s_[l][k]);
-                        cLogU0.mul(x0s_[l][k]); // (x[k-1] . log u[k-2])
-                        denominator += cLogU0.sumSqrs();  // (x[k-1] . log u[k-2]) T (x[k-1] . log u[k-2])
-
-                        // update to new gradient vector 'u0s'
-                        MatrixSparse t;
-                        t.copySubset(y0s_[l][k], xs()[l][k]);
-                        u0s_[l][k].divNonzeros(xs()[l][k], t);
-
-                        t.copySubset(cLogU0, xs()[l][k]);
+                    ostringstream oss;
+                    oss << getTimeStamp() << "     " << l << " OptimizerAccelerationEve1::acceleration0";
+                    info(oss.str());
+                }
 
-                        // using new gradient vector 'u0s'
-                        MatrixSparse c1LogU;
-                        c1LogU.lnNonzeros(u0s_[l][k]);
-                        c1LogU.mul(xs()[l][k]); // (x[k] . log u[k-1])
-                        c1LogU.mul(t); // (x[k] . log u[k-1]) . (x[k-1] . log u[k-2])
-                        numerator += c1LogU.sum(); // (x[k] . log u[k-1]) T (x[k-1] . log u[k-2])
-                    }
+                // no extrapolation this iteration, just save 'xs'
+                for (ii k = 0; k < ii(xs()[l].size()); k++)
+                {
+                    y0s_[l][k].copy(xs()[l][k]);
+                    y0s_[l][k].setPrecision(precision_);
                 }
             }
-            a = fp(numerator / denominator);
-            fp aThresh = a > 0.0f ? a : 0.0f;
-            aThresh = aThresh < 1.0f ? aThresh : 1.0f;
-
-            // linear extrapolation of 'xs'
-            for (ii l = 0; l < ii(getBases().size()); l++)
+        }
+    }
+    else if (iteration_ == 1)
+    {
+        for (ii l = 0; l < (ii)getBases().size(); l++)
+        {
+            if (!getBases()[l]->isTransient())
             {
-                if (!getBases()[l]->isTransient())
+                for (ii k = 0; k < ii(xs()[l].size()); k++)
                 {
                     if (getDebugLevel() % 10 >= 3)
                     {
                         ostringstream oss;
-                        oss << getTimeStamp() << "     " << l << " OptimizerAccelerationEve1::acceleration2+";
+                        oss << getTimeStamp() << "     " << l << " OptimizerAccelerationEve1::acceleration1";
                         info(oss.str());
                     }
+                    // can now calcaulte first gradient vector 'u0s'
+                    MatrixSparse t;
+                    t.copySubset(y0s_[l][k], xs()[l][k]);
 
-                    for (ii k = 0; k < ii(xs()[l].size()); k++)
-                    {
-                        // extrapolate 'xs' and save for next iteration as 'y0s'
-                        y0s_[l][k].copy(xs()[l][k]);
-
-                        MatrixSparse t;
-                        t.copySubset(x0s_[l][k], xs()[l][k]);
-
-                        y0s_[l][k].divNonzeros(t);
-                        y0s_[l][k].pow(aThresh);
-                        y0s_[l][k].mul(xs()[l][k]); // x[k] . (x[k] / x[k-1])^a
-
-                        x0s_[l][k].copy(xs()[l][k]); // previous 'xs' saved as 'x0s' for next iteration
-                        xs()[l][k].copy(y0s_[l][k]); // extrapolated 'xs' for this iteration
-                    }
+                    u0s_[l][k].divNonzeros(xs()[l][k], t);
+                    u0s_[l][k].setPrecision(precision_);
+                    // no extrapolation this iteration, just save 'xs'
+                    x0s_[l][k].copy(xs()[l][k]);
+                    x0s_[l][k].setPrecision(precision_);
+                    y0s_[l][k].copy(xs()[l][k]);
+                    y0s_[l][k].setPrecision(precision_);
                 }
             }
         }
     }
-    double accelerationDuration = getElapsedTime() - accelerationStart;
-
-    if (getDebugLevel() % 10 >= 3)
-        cout << getTimeStamp() << fixed << setprecision(4) <<  "    acceleration       = " << a << endl;
-
-
-    if (getDebugLevel() % 10 >= 2 && getElapsedTime() != 0.0)
+    else
     {
-        accelerationDuration_ += accelerationDuration;
-
-        cout << getTimeStamp()  << "    duration_acceleration = " << fixed << setprecision(6) << setw(12) << accelerationDuration << "  total = " << setprecision(4) << setw(12) << accelerationDuration_ << endl;
-    }
+        fp aThresh = a > 0.0f ? a : 0.0f;
+        aThresh = aThresh < 1.0f ? aThresh : 1.0f;
 
-    // now perform the optimizer iteration on the extrapolated 'xs'
-    return optimizer_->step();
-}
-
-
-void OptimizerAccelerationEve1::synthesize(vector<MatrixSparse>& f, vector< vector<MatrixSparse> >& xEs, ii basis)
-{
-    optimizer_->synthesize(f, xEs, basis);
-}
-
-
-void
-OptimizerAccelerationEve1::analyze(std::vector< std::vector<MatrixSparse> > &xEs, std::vector<MatrixSparse> &fE, bool l2, bool l2Normalize) const
-{
-    optimizer_->analyze(xEs, fE, l2, l2Normalize);
-}
-
-
-ii OptimizerAccelerationEve1::getIteration() const
-{
-    return optimizer_->getIteration();
-}
-
-
-const std::vector<Basis*>& OptimizerAccelerationEve1::getBases() const
-{
-    return optimizer_->getBases();
-}
-
-
-std::vector< std::vector<MatrixSparse> >& OptimizerAccelerationEve1::xs()
-{
-    return optimizer_->xs();
-}
-
-
-std::vector< std::vector<MatrixSparse> >& OptimizerAccelerationEve1::l2s()
-{
-    return optimizer_->l2s();
-}
-
-
-std::vector< std::vector<MatrixSparse> >& OptimizerAccelerationEve1::l1l2s()
-{
-    return optimizer_->l1l2s();
-}
-
-
-// TODO: quadratic vector extrapolation below
-/*
-        else if (iteration_ == 1) // linear vector extrapolation this time, but save the qs
+        // linear extrapolation of 'xs'
+        for (ii l = 0; l < ii(getBases().size()); l++)
         {
-            for (ii j = 0; j < (ii)bases_.size(); j++)
+            if (!getBases()[l]->isTransient())
             {
-                if (!bases_[j]->isTransient())
+                if (getDebugLevel() % 10 >= 3)
                 {
-                    //#pragma omp parallel for reduction(+:sum,sumd)
-                    for (li i = 0; i < cs_[j].size(); i++)
-                    {
-                        if (cs_[j].vs_[i] > 0.0)
-                        {
-                            fp q = cEs[j].vs_[i] / c0s_[j].vs_[i];
-                            fp c1 = cEs[j].vs_[i] * powf(cEs[j].vs_[i] / c0s_[j].vs_[i], a);
-
-                            sum += cs_[j].vs_[i] * cs_[j].vs_[i];
-                            sumd += (c1 - cs_[j].vs_[i])*(c1 - cs_[j].vs_[i]);
-
-                            // for this itteration
-                            cs_[j].vs_[i] = c1;
-
-                            // for next itteration
-                            c0s_[j].vs_[i] = cEs[j].vs_[i];
-                            q0s_[j].vs_[i] = q;
-                        }
-                    }
-                    cEs[j].free();
+                    ostringstream oss;
+                    oss << getTimeStamp() << "     " << l << " OptimizerAccelerationEve1::acceleration2+";
+                    info(oss.str());
                 }
-            }
-        }
-        else // quadratic vector extrapolation
-        {
-            for (ii j = 0; j < (ii)bases_.size(); j++)
-            {
-                if (!bases_[j]->isTransient())
-                {
-                    //#pragma omp parallel for reduction(+:sum,sumd)
-                    for (li i = 0; i < cs_[j].size(); i++)
-                    {
-                        if (cs_[j].vs_[i] > 0.0)
-                        {
-                            fp q = cEs[j].vs_[i] / c0s_[j].vs_[i];
-                            fp c1 = cEs[j].vs_[i] * powf(q, a) * powf(q / q0s_[j].vs_[i], 0.5f*a*a);
 
-                            sum += cs_[j].vs_[i] * cs_[j].vs_[i];
-                            sumd += (c1 - cs_[j].vs_[i])*(c1 - cs_[j].vs_[i]);
-
-                            // for this itteration
-                            cs_[j].vs_[i] = c1;
-
-                            // for next itteration
-                            c0s_[j].vs_[i] = cEs[j].vs_[i];
-                            q0s_[j].vs_[i] = q;
-                        }
-                    }
-                    cEs[j].free();
-                }
+                for (ii k = 0; k < ii(xs()[l].size()); k++)
+                    extrapolate(l, k, aThresh);
             }
         }
     }
 
-    return sqrt(sumd) / sqrt(sum);
-*/
+    return a;
+}
+
 
+void OptimizerAccelerationEve1::extrapolate(ii l, ii k, fp a)
+{
+    // extrapolate 'xs' and save for next iteration as 'y0s'
+    y0s_[l][k].copy(xs()[l][k]);
+
+    MatrixSparse t;
+    t.copySubset(x0s_[l][k], xs()[l][k]);
 
+    y0s_[l][k].divNonzeros(t);
+    y0s_[l][k].pow(a);
+    y0s_[l][k].mul(xs()[l][k]); // x[k] . (x[k] / x[k-1])^a
 
+    x0s_[l][k].copy(xs()[l][k]); // previous 'xs' saved as 'x0s' for next iteration
+    x0s_[l][k].setPrecision(precision_);
+    xs()[l][k].copy(y0s_[l][k]); // extrapolated 'xs' for this iteration
+    y0s_[l][k].setPrecision(precision_);
+}
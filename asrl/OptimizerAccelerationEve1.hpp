@@ -24,7 +24,7 @@
 #define SEAMASS_ASRL_OPTIMIZERACCELERATIONEVE1_HPP
 
 
-#include "Optimizer.hpp"
+#include "OptimizerAcceleration.hpp"
 
 
 /**
@@ -39,35 +39,20 @@
 *  ii) [Wang & Miller, IEEE Trans Imag Proc 2014] provide a Scaled Heavy-Ball method with a convergence rate proof and
     show Vector Extrapolation is a special case. However, again this is the non-exponentiated version.
 */
-class OptimizerAccelerationEve1 : public Optimizer
+class OptimizerAccelerationEve1 : public OptimizerAcceleration
 {
 public:    
-    OptimizerAccelerationEve1(Optimizer* optimizer);
+    OptimizerAccelerationEve1(Optimizer* optimizer, MatrixSparse::Precision precision = MatrixSparse::Precision::Single);
     virtual ~OptimizerAccelerationEve1();
-    
-    virtual void setLambda(fp lambda, fp lambdaGroup = fp(0.0));
-    virtual const std::vector<Basis*>& getBases() const;
-    virtual ii getIteration() const;
 
-    virtual fp step();
-
-    virtual void synthesize(std::vector<MatrixSparse>& f, std::vector< std::vector<MatrixSparse> >& xEs, ii basis = -1);
-    virtual void analyze(std::vector< std::vector<MatrixSparse> > &xEs, std::vector<MatrixSparse> &fE, bool l2, bool l2Normalize = true) const;
-
-    std::vector< std::vector<MatrixSparse> >& xs();
-    std::vector< std::vector<MatrixSparse> >& l2s();
-    std::vector< std::vector<MatrixSparse> >& l1l2s();
-
-private:
-    Optimizer* optimizer_;
+protected:
+    virtual fp accelerate();
+    virtual void extrapolate(ii l, ii k, fp a); // extrapolate xs()[l][k] with acceleration parameter a, saving its state for the next iteration
 
     std::vector< std::vector<MatrixSparse> > x0s_;
     std::vector< std::vector<MatrixSparse> > y0s_;
     std::vector< std::vector<MatrixSparse> > u0s_;
-    
-    double accelerationDuration_;
 };
 
 
 #endif
-
@@ -0,0 +1,81 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#include "OptimizerAccelerationEve2.hpp"
+#include <kernel.hpp>
+using namespace std;
+using namespace kernel;
+
+
+OptimizerAccelerationEve2::OptimizerAccelerationEve2(Optimizer* optimizer, MatrixSparse::Precision precision) : OptimizerAccelerationEve1(optimizer, precision)
+{
+    if (getDebugLevel() % 10 >= 1)
+        cout << getTimeStamp() << "  ... with 2nd order extrapolation (EVE2)" << endl;
+
+    q0s_.resize(xs().size());
+    for (ii k = 0; k < ii(xs().size()); k++)
+        q0s_[k].resize(xs()[k].size());
+}
+
+
+OptimizerAccelerationEve2::~OptimizerAccelerationEve2()
+{
+}
+
+
+void OptimizerAccelerationEve2::extrapolate(ii l, ii k, fp a)
+{
+    // ratio 'q' between this and the previous 'xs'
+    MatrixSparse q;
+    q.copy(xs()[l][k]);
+    {
+        MatrixSparse t;
+        t.copySubset(x0s_[l][k], xs()[l][k]);
+        q.divNonzeros(t);
+    }
+
+    // extrapolate 'xs' and save for next iteration as 'y0s'
+    y0s_[l][k].copy(q);
+    y0s_[l][k].pow(a);
+    y0s_[l][k].mul(xs()[l][k]); // x[k] . q^a
+
+    // first extrapolation has no previous ratio, so is linear
+    if (iteration_ > 2)
+    {
+        MatrixSparse t;
+        t.copySubset(q0s_[l][k], xs()[l][k]);
+
+        MatrixSparse r;
+        r.copy(q);
+        r.divNonzeros(t);
+        r.pow(fp(0.5) * a * a);
+        y0s_[l][k].mul(r); // x[k] . q^a . (q / q[k-1])^(a^2/2)
+    }
+
+    q0s_[l][k].swap(q); // ratio saved as 'q0s' for next iteration
+    q0s_[l][k].setPrecision(precision_);
+    x0s_[l][k].copy(xs()[l][k]); // previous 'xs' saved as 'x0s' for next iteration
+    x0s_[l][k].setPrecision(precision_);
+    xs()[l][k].copy(y0s_[l][k]); // extrapolated 'xs' for this iteration
+    y0s_[l][k].setPrecision(precision_);
+}
@@ -0,0 +1,53 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#ifndef SEAMASS_ASRL_OPTIMIZERACCELERATIONEVE2_HPP
+#define SEAMASS_ASRL_OPTIMIZERACCELERATIONEVE2_HPP
+
+
+#include "OptimizerAccelerationEve1.hpp"
+
+
+/**
+* OptimizerAccelerationEve2 accelerates a wrapped Optimizer with 2nd Order Exponential Vector Extrapolation (EVE2)
+*
+* Notes:
+*  i) The acceleration parameter 'a' is found as for EVE1, but the extrapolation adds a quadratic term in the change of
+*   the ratio between successive iterates, i.e. x[k] . q^a . (q / q[k-1])^(a^2/2) where q = x[k] / x[k-1]. This is
+*   the exponentiated form of the second order scheme in Section 3.6 of the Biggs thesis cited by EVE1.
+*  ii) Each coefficient needs one more stored ratio than EVE1.
+*/
+class OptimizerAccelerationEve2 : public OptimizerAccelerationEve1
+{
+public:
+    OptimizerAccelerationEve2(Optimizer* optimizer, MatrixSparse::Precision precision = MatrixSparse::Precision::Single);
+    virtual ~OptimizerAccelerationEve2();
+
+protected:
+    virtual void extrapolate(ii l, ii k, fp a);
+
+    std::vector< std::vector<MatrixSparse> > q0s_; // ratio x[k-1] / x[k-2] from the previous extrapolation
+};
+
+
+#endif
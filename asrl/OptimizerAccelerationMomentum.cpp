@@ -0,0 +1,172 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#include "OptimizerAccelerationMomentum.hpp"
+#include <kernel.hpp>
+#include <cmath>
+#include <sstream>
+using namespace std;
+using namespace kernel;
+
+
+OptimizerAccelerationMomentum::OptimizerAccelerationMomentum(Optimizer* optimizer, MatrixSparse::Precision precision) : OptimizerAcceleration(optimizer, precision), t_(1.0), restarts_(0)
+{
+    if (getDebugLevel() % 10 >= 1)
+        cout << getTimeStamp() << "  Initialising Restarted Momentum Acceleration ..." << endl;
+
+    // temporaries required for acceleration
+    x0s_.resize(xs().size());
+    y0s_.resize(xs().size());
+    for (ii l = 0; l < ii(xs().size()); l++)
+    {
+        x0s_[l].resize(xs()[l].size());
+        y0s_[l].resize(xs()[l].size());
+    }
+}
+
+
+OptimizerAccelerationMomentum::~OptimizerAccelerationMomentum()
+{
+}
+
+
+fp OptimizerAccelerationMomentum::accelerate()
+{
+    // momentum built up before a change of lambda heads for the old optimum, and restarting just the sequence 't'
+    // would be no different, so it is never preserved
+    if (iteration_ == 0 || lambdaChanged_)
+    {
+        // no momentum this iteration, just save 'xs'
+        for (ii l = 0; l < ii(getBases().size()); l++)
+        {
+            if (!getBases()[l]->isTransient())
+            {
+                for (ii k = 0; k < ii(xs()[l].size()); k++)
+                {
+                    x0s_[l][k].copy(xs()[l][k]);
+                    x0s_[l][k].setPrecision(precision_);
+                    y0s_[l][k].copy(xs()[l][k]);
+                    y0s_[l][k].setPrecision(precision_);
+                }
+            }
+        }
+        t_ = 1.0;
+
+        return 0.0;
+    }
+
+    // restart test (G(y) - y)^T (x[k] - x[k-1]), bringing 'x0s' onto the current pattern as we go
+    double restart = 0.0;
+    for (ii l = 0; l < ii(getBases().size()); l++)
+    {
+        if (!getBases()[l]->isTransient())
+        {
+            if (getDebugLevel() % 10 >= 3)
+            {
+                ostringstream oss;
+                oss << getTimeStamp() << "     " << l << " OptimizerAccelerationMomentum::restart";
+                info(oss.str());
+            }
+
+            for (ii k = 0; k < ii(xs()[l].size()); k++)
+            {
+                assert(xs()[l][k].getPrecision() == MatrixSparse::Precision::Single);
+
+                MatrixSparse y, t;
+                y.copySubset(y0s_[l][k], xs()[l][k]);
+                const fp* ys = values(y, t);
+
+                MatrixSparse x0, u;
+                x0.copySubset(x0s_[l][k], xs()[l][k]);
+                x0s_[l][k].swap(x0);
+                const fp* x0s = values(x0s_[l][k], u);
+
+                const fp* x = xs()[l][k].vs();
+                #pragma omp parallel for reduction(+:restart)
+                for (ii nz = 0; nz < xs()[l][k].nnz(); nz++)
+                    restart += (double(x[nz]) - ys[nz]) * (double(x[nz]) - x0s[nz]);
+            }
+        }
+    }
+
+    double beta = 0.0;
+    if (restart < 0.0)
+    {
+        t_ = 1.0;
+        restarts_++;
+    }
+    else
+    {
+        double t = 0.5 * (1.0 + sqrt(1.0 + 4.0 * t_ * t_));
+        beta = (t_ - 1.0) / t;
+        t_ = t;
+    }
+
+    if (getDebugLevel() % 10 >= 3)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "     restarts = " << restarts_;
+        info(oss.str());
+    }
+
+    // 'y = x[k] + beta . (x[k] - x[k-1])', keeping 'x[k]' wherever that would not be positive
+    for (ii l = 0; l < ii(getBases().size()); l++)
+    {
+        if (!getBases()[l]->isTransient())
+        {
+            if (getDebugLevel() % 10 >= 3)
+            {
+                ostringstream oss;
+                oss << getTimeStamp() << "     " << l << " OptimizerAccelerationMomentum::extrapolate";
+                info(oss.str());
+            }
+
+            for (ii k = 0; k < ii(xs()[l].size()); k++)
+            {
+                MatrixSparse x0;
+                x0.copy(x0s_[l][k]);
+
+                x0s_[l][k].copy(xs()[l][k]); // 'xs' saved as 'x0s' for next iteration
+                x0s_[l][k].setPrecision(precision_);
+
+                if (beta > 0.0)
+                {
+                    fp* x = xs()[l][k].vs();
+                    const fp* x0s = x0.vs();
+                    #pragma omp parallel for
+                    for (ii nz = 0; nz < xs()[l][k].nnz(); nz++)
+                    {
+                        double y = x[nz] + beta * (double(x[nz]) - x0s[nz]);
+                        if (y > 0.0)
+                            x[nz] = fp(y);
+                    }
+                }
+
+                y0s_[l][k].copy(xs()[l][k]); // extrapolated 'xs' saved as 'y0s' for next iteration
+                y0s_[l][k].setPrecision(precision_);
+            }
+        }
+    }
+
+    return fp(beta);
+}
@@ -0,0 +1,61 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+
+#ifndef SEAMASS_ASRL_OPTIMIZERACCELERATIONMOMENTUM_HPP
+#define SEAMASS_ASRL_OPTIMIZERACCELERATIONMOMENTUM_HPP
+
+
+#include "OptimizerAcceleration.hpp"
+
+
+/**
+* OptimizerAccelerationMomentum accelerates a wrapped Optimizer with Nesterov momentum and adaptive restart
+*
+* Notes:
+*  i) Each iteration starts from y = x[k] + beta . (x[k] - x[k-1]) with beta from the usual FISTA sequence
+*   [Beck & Teboulle, SIAM J Imaging Sci 2009].
+*  ii) The momentum is restarted whenever the last step went against it, i.e. (G(y) - y)^T (x[k] - x[k-1]) < 0, the
+*   gradient scheme of [O'Donoghue & Candes, Found Comput Math 2015].
+*  iii) Richardson-Lucy needs strictly positive coefficients, so any coefficient the momentum would take to zero or below
+*   keeps its unaccelerated value.
+*  iv) The momentum always restarts when lambda changes, even if asked to preserve its state.
+*/
+class OptimizerAccelerationMomentum : public OptimizerAcceleration
+{
+public:
+    OptimizerAccelerationMomentum(Optimizer* optimizer, MatrixSparse::Precision precision = MatrixSparse::Precision::Single);
+    virtual ~OptimizerAccelerationMomentum();
+
+protected:
+    virtual fp accelerate();
+
+private:
+    double t_; // FISTA sequence, 1 after a restart
+    ii restarts_;
+
+    std::vector< std::vector<MatrixSparse> > x0s_; // output of the previous iteration
+    std::vector< std::vector<MatrixSparse> > y0s_; // input to the last iteration
+};
+
+
+#endif
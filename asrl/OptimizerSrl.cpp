@@ -26,31 +26,99 @@
 #include <cmath>
 #include <sstream>
 #include <limits>
+#include <algorithm>
+#include <exception>
+#include <cassert>
+#if defined(_OPENMP)
+  #include <omp.h>
+#endif
 using namespace std;
 using namespace kernel;
 
 
-OptimizerSrl::OptimizerSrl(const vector<Basis*>& bases, const std::vector<Matrix>& b, bool seed, fp pruneThreshold) : bases_(bases), b_(b), pruneThreshold_(pruneThreshold), lambda_(0.0), lambdaGroup_(0.0), iteration_(0), synthesisDuration_(0.0), errorDuration_(0.0), analysisDuration_(0.0), shrinkageDuration_(0.0), updateDuration_(0.0)
+OptimizerSrl::OptimizerSrl(const vector<Basis*>& bases, const std::vector<Matrix>& b, bool seed, fp pruneThreshold, MatrixSparse::Precision precision) : bases_(bases), b_(b), pruneThreshold_(pruneThreshold), precision_(precision), freezeTolerance_(0.0), freezeInterval_(0), lambda_(0.0), lambdaGroup_(0.0), iteration_(0), synthesisDuration_(0.0), errorDuration_(0.0), analysisDuration_(0.0), shrinkageDuration_(0.0), updateDuration_(0.0)
 {
     if (getDebugLevel() % 10 >= 1)
         cout << getTimeStamp() << "  Creating optimizer SRL ..." << endl;
 
+    {   // schedule the tree: in analysis each basis follows its parent and in synthesis its children, so siblings run
+        // alongside each other
+        vector<ii> waves(bases_.size(), 0);
+        for (ii l = 1; l < ii(bases_.size()); l++)
+            waves[l] = waves[bases_[l]->getParentIndex()] + 1;
+        for (ii l = 0; l < ii(bases_.size()); l++)
+        {
+            if (ii(analysisSchedule_.size()) <= waves[l])
+                analysisSchedule_.resize(waves[l] + 1);
+            analysisSchedule_[waves[l]].push_back(l);
+        }
+
+        waves.assign(bases_.size(), 0);
+        for (ii l = ii(bases_.size()) - 1; l > 0; l--)
+        {
+            ii p = bases_[l]->getParentIndex();
+            waves[p] = max(waves[p], waves[l] + 1);
+        }
+        for (ii l = ii(bases_.size()) - 1; l >= 0; l--)
+        {
+            if (ii(synthesisSchedule_.size()) <= waves[l])
+                synthesisSchedule_.resize(waves[l] + 1);
+            synthesisSchedule_[waves[l]].push_back(l);
+        }
+    }
+
     if (seed)
     {
         {   // compute L2 and L1 norm of each basis function and store in 'l2s' and 'l1l2s'
             if (getDebugLevel() % 10 >= 1)
-                cout << getTimeStamp() << "  Initialising L2 norms ..." << endl;
+                cout << getTimeStamp() << "  Initialising L2 and L1 norms ..." << endl;
+
+            // bases that can, produce both norms from their parent's in a single walk down the tree
+            vector< vector<MatrixSparse> > l1s(bases_.size());
+            vector<MatrixSparse> none;
+            l2s_.resize(bases_.size());
+            bool analytic = true;
+            for (ii l = 0; analytic && l < ii(bases_.size()); l++)
+            {
+                ii p = bases_[l]->getParentIndex();
+                analytic = bases_[l]->analyzeNorms(l1s[l], l2s_[l], p < 0 ? none : l1s[p], p < 0 ? none : l2s_[p]);
+            }
 
-            vector<MatrixSparse> t(b_.size());
-            for (ii k = 0; k < ii(t.size()); k++)
-                t[k].copy(1, b_[k].n(), fp(1.0));
+            if (analytic)
+            {
+                l1l2sPlusLambda_.resize(bases_.size());
+                for (ii l = 0; l < ii(bases_.size()); l++)
+                {
+                    if (bases_[l]->isTransient())
+                    {
+                        l1l2sPlusLambda_[l].swap(l1s[l]);
+                    }
+                    else
+                    {
+                        l1l2sPlusLambda_[l].resize(l1s[l].size());
+                        for (ii k = 0; k < ii(l1s[l].size()); k++)
+                        {
+                            l2s_[l][k].sqrt();
+                            l1l2sPlusLambda_[l][k].divNonzeros(l1s[l][k], l2s_[l][k]);
+                            l1s[l][k].free();
+                        }
+                    }
+                }
+            }
+            else
+            {
+                // otherwise analyse ones, with a row for each row of b so that every row of coefficients has norms
+                vector<MatrixSparse> t(b_.size());
+                for (ii k = 0; k < ii(t.size()); k++)
+                    t[k].copy(b_[k].m(), b_[k].n(), fp(1.0));
 
-            analyze(l2s_, t, true, false);
+                analyze(l2s_, t, true, false);
 
-            if (getDebugLevel() % 10 >= 1)
-                cout << getTimeStamp() << "  Initialising L1 norms of L2 norms ..." << endl;
+                if (getDebugLevel() % 10 >= 1)
+                    cout << getTimeStamp() << "  Initialising L1 norms of L2 norms ..." << endl;
 
-            analyze(l1l2sPlusLambda_, t, false);
+                analyze(l1l2sPlusLambda_, t, false);
+            }
         }
 
         {   // initialise starting estimate of 'x' from analysis of 'b'
@@ -89,7 +157,8 @@ OptimizerSrl::OptimizerSrl(const vector<Basis*>& bases, const std::vector<Matrix
                         x.divNonzeros(xs_[l][k], l1l2PlusLambda);
                         l1l2PlusLambda.free();
                         x.mul((fp) (sumB / sumX));
-                        xs_[l][k].copyPrune(x, pruneThreshold);
+                        x.prune(pruneThreshold);
+                        xs_[l][k].swap(x);
                         x.free();
 
                         // remove unneeded l2s
@@ -100,6 +169,10 @@ OptimizerSrl::OptimizerSrl(const vector<Basis*>& bases, const std::vector<Matrix
                         // remove unneeded l1l2s
                         t.copySubset(l1l2sPlusLambda_[l][k], xs_[l][k]);
                         l1l2sPlusLambda_[l][k].swap(t);
+
+                        // from now on these are only read by the multiplicative updates
+                        l2s_[l][k].setPrecision(precision_);
+                        l1l2sPlusLambda_[l][k].setPrecision(precision_);
                     }
                 }
             }
@@ -130,6 +203,26 @@ void OptimizerSrl::setLambda(fp lambda, fp lambdaGroup)
     lambda_ = lambda;
     lambdaGroup_ = lambdaGroup;
     iteration_ = 0;
+
+    // the new lambda moves every observation's optimum
+    frozen_.assign(frozen_.size(), 0);
+}
+
+
+void OptimizerSrl::setFreezing(fp tolerance, ii interval)
+{
+    if (interval > 0 && bases_.front()->isTransient())
+        throw runtime_error("ERROR: observations can only be frozen if each has its own row of coefficients");
+
+    ii observations = 0;
+    for (ii k = 0; k < ii(b_.size()); k++)
+        observations += b_[k].m();
+
+    freezeTolerance_ = tolerance;
+    freezeInterval_ = interval;
+    frozen_.assign(interval > 0 ? observations : 0, 0);
+    observationSumSqrs_.assign(frozen_.size(), 0.0);
+    observationSumSqrDiffs_.assign(frozen_.size(), 0.0);
 }
 
 
@@ -137,6 +230,17 @@ fp OptimizerSrl::step()
 {
     iteration_++;
 
+    // frozen observations are skipped, except on every freezeInterval_ iterations where every observation is updated
+    // and has its convergence re-checked
+    bool freezing = freezeInterval_ > 0 && iteration_ % freezeInterval_ != 0;
+    vector<char> observations;
+    if (freezing)
+    {
+        observations.resize(frozen_.size());
+        for (ii k = 0; k < ii(observations.size()); k++)
+            observations[k] = !frozen_[k];
+    }
+
     // SYNTHESISE
     if (getDebugLevel() % 10 >= 3)
         cout << getTimeStamp() << "    Synthesis ..." << endl;
@@ -145,7 +249,7 @@ fp OptimizerSrl::step()
     vector< vector<MatrixSparse> > xEs_ys;
     double synthesisStart = getElapsedTime();
     {
-        synthesize(f_fE, xEs_ys);
+        synthesize(f_fE, xEs_ys, -1, freezing ? &observations : 0);
     }
     double synthesisDuration = getElapsedTime() - synthesisStart;
 
@@ -155,16 +259,32 @@ fp OptimizerSrl::step()
 
     double errorStart = getElapsedTime();
     {
-        for (ii k = 0; k < ii(f_fE.size()); k++)
+        for (ii k = 0, i0 = 0; k < ii(f_fE.size()); i0 += b_[k].m(), k++)
         {
+            if (freezing)
+            {
+                vector<char> rows(observations.begin() + i0, observations.begin() + i0 + b_[k].m());
+                ii rowsFrozen = ii(count(rows.begin(), rows.end(), 0));
+
+                if (rowsFrozen == b_[k].m())
+                {
+                    // frozen observations are left empty so that they are skipped by the analysis
+                    f_fE[k].init(b_[k].m(), b_[k].n());
+                    continue;
+                }
+                else if (rowsFrozen > 0)
+                {
+                    MatrixSparse t;
+                    t.copyRows(f_fE[k], rows);
+                    f_fE[k].swap(t);
+                }
+            }
+
             // any zeros in f_fE are due to underflow. We need to do this to avoid divide by zero error
             f_fE[k].censorLeft(numeric_limits<fp>::min());
             f_fE[k].div2(b_[k]);
-
-            MatrixSparse t;
-            t.copyPrune(f_fE[k]);
-            f_fE[k].swap(t);
-         }
+            f_fE[k].prune();
+        }
     }
     double errorDuration = getElapsedTime() - errorStart;
 
@@ -180,7 +300,29 @@ fp OptimizerSrl::step()
 
     double analysisStart = getElapsedTime();
     {
-        analyze(xEs_ys, f_fE, false);
+        if (freezing)
+        {
+            // frozen observations leave holes in the rows analysed, so fill them with zeros before normalising
+            analyze(xEs_ys, f_fE, false, false);
+
+            for (ii l = 0; l < ii(bases_.size()); l++)
+            {
+                if (!bases_[l]->isTransient())
+                {
+                    for (ii k = 0; k < ii(xEs_ys[l].size()); k++)
+                    {
+                        MatrixSparse t;
+                        t.copySubset(xEs_ys[l][k], xs_[l][k]);
+                        xEs_ys[l][k].swap(t);
+                        xEs_ys[l][k].divNonzeros(l2s_[l][k]);
+                    }
+                }
+            }
+        }
+        else
+        {
+            analyze(xEs_ys, f_fE, false);
+        }
 
         for (ii k = 0; k < ii(f_fE.size()); k++)
             f_fE[k].free();
@@ -268,11 +410,12 @@ fp OptimizerSrl::step()
         cout << getTimeStamp() << "    Termination Check and Pruning..." << endl;
 
     fp sumSqrs = 0.0;
-    fp sumSqrs2 = 0.0;
     fp sumSqrDiffs = 0.0;
+    vector<double> observationSumSqrs(frozen_.size(), 0.0);
+    vector<double> observationSumSqrDiffs(frozen_.size(), 0.0);
     double updateStart = getElapsedTime();
     {
-        // termination check
+        // termination check and copy into xs_, pruning small coefficients (and their l1l2s and l2s) in the same pass
         for (ii l = 0; l < ii(bases_.size()); l++)
         {
             if (!bases_[l]->isTransient())
@@ -280,45 +423,53 @@ fp OptimizerSrl::step()
                 if (getDebugLevel() % 10 >= 3)
                 {
                     ostringstream oss;
-                    oss << getTimeStamp() << "     " << l << " OptimizerSrl::updateGradient";
+                    oss << getTimeStamp() << "     " << l << " OptimizerSrl::update";
                     info(oss.str());
                 }
 
                 for (ii k = 0; k < ii(xs_[l].size()); k++)
                 {
-                    sumSqrs += xs_[l][k].sumSqrs();
-                    sumSqrs2 += xEs_ys[l][k].sumSqrs();
-                    sumSqrDiffs += xs_[l][k].sumSqrDiffsNonzeros(xEs_ys[l][k]);
+                    if (freezeInterval_ > 0)
+                    {
+                        if (xs_[l].size() != 1 || xs_[l][k].m() != ii(frozen_.size()))
+                            throw runtime_error("ERROR: observations can only be frozen if each has its own row of coefficients");
+
+                        // frozen observations had nothing to analyse, so their rows keep their coefficients
+                        if (freezing)
+                            xEs_ys[l][k].copySubset(xs_[l][k], frozen_);
+
+                        xEs_ys[l][k].sumSqrDiffsRows(xs_[l][k], observationSumSqrs, observationSumSqrDiffs);
+                    }
+
+                    vector<MatrixSparse*> as = { &l1l2sPlusLambda_[l][k], &l2s_[l][k] };
+                    xEs_ys[l][k].pruneUpdate(pruneThreshold_, xs_[l][k], as, sumSqrs, sumSqrDiffs);
+                    xs_[l][k].swap(xEs_ys[l][k]);
+                    xEs_ys[l][k].free();
+
+                    // no-op unless they were imported from a seed
+                    l1l2sPlusLambda_[l][k].setPrecision(precision_);
+                    l2s_[l][k].setPrecision(precision_);
                 }
             }
         }
 
-        // copy into xs_, pruning small coefficients
-        for (ii l = 0; l < ii(bases_.size()); l++)
+        if (freezeInterval_ > 0)
         {
-            if (!bases_[l]->isTransient())
+            // frozen observations count with their change when last updated, so the termination check still covers
+            // them, and each updated observation is frozen once its own relative change is within tolerance
+            sumSqrs = 0.0;
+            sumSqrDiffs = 0.0;
+            for (ii k = 0; k < ii(frozen_.size()); k++)
             {
-                if (getDebugLevel() % 10 >= 3)
+                if (!(freezing && frozen_[k]))
                 {
-                    ostringstream oss;
-                    oss << getTimeStamp() << "     " << l << " OptimizerSrl::updatePrune";
-                    info(oss.str());
+                    observationSumSqrs_[k] = observationSumSqrs[k];
+                    observationSumSqrDiffs_[k] = observationSumSqrDiffs[k];
+                    frozen_[k] = sqrt(observationSumSqrDiffs[k]) <= freezeTolerance_ * sqrt(observationSumSqrs[k]);
                 }
 
-                for (ii k = 0; k < ii(xs_[l].size()); k++)
-                {
-                    xs_[l][k].copyPrune(xEs_ys[l][k], pruneThreshold_);
-                    xEs_ys[l][k].free();
-
-                    // prune l1l2s
-                    MatrixSparse t;
-                    t.copySubset(l1l2sPlusLambda_[l][k], xs_[l][k]);
-                    l1l2sPlusLambda_[l][k].swap(t);
-
-                    // prune l2s
-                    t.copySubset(l2s_[l][k], xs_[l][k]);
-                    l2s_[l][k].swap(t);
-                }
+                sumSqrs += fp(observationSumSqrs_[k]);
+                sumSqrDiffs += fp(observationSumSqrDiffs_[k]);
             }
         }
     }
@@ -338,6 +489,8 @@ fp OptimizerSrl::step()
         cout << getTimeStamp()  << "    duration_shrinkage    = " << fixed << setprecision(6) << setw(12) << shrinkageDuration << "  total = " << setprecision(4) << setw(12) << shrinkageDuration_ << endl;
         cout << getTimeStamp()  << "    duration_update       = " << fixed << setprecision(6) << setw(12) << updateDuration << "  total = " << setprecision(4) << setw(12) << updateDuration_ << endl;
         cout << getTimeStamp()  << "                                     total_sort = " << setprecision(4) << setw(12) << MatrixSparse::sortElapsed_ << endl;
+        if (freezeInterval_ > 0)
+            cout << getTimeStamp()  << "    frozen_observations   = " << setw(12) << count(frozen_.begin(), frozen_.end(), 1) << "  of    " << setw(12) << frozen_.size() << endl;
      }
 
     return sqrt(sumSqrDiffs) / sqrt(sumSqrs);
@@ -345,11 +498,18 @@ fp OptimizerSrl::step()
 
 
 void OptimizerSrl::synthesize(vector<MatrixSparse>& f, vector< vector<MatrixSparse> >& xEs, ii basis)
+{
+    synthesize(f, xEs, basis, 0);
+}
+
+
+void OptimizerSrl::synthesize(vector<MatrixSparse>& f, vector< vector<MatrixSparse> >& xEs, ii basis, const vector<char>* observations)
 {
     if (xEs.size() != bases_.size())
         xEs.resize(bases_.size());
 
-    for (ii l = ii(bases_.size()) - 1; l >= 0; l--)
+    // coefficients of a non-transient basis start from its own control points
+    auto controlPoints = [&](ii l)
     {
         if (!xEs[l].size() && !bases_[l]->isTransient())
         {
@@ -361,37 +521,90 @@ void OptimizerSrl::synthesize(vector<MatrixSparse>& f, vector< vector<MatrixSpar
                     xEs[l][k].divNonzeros(xs_[l][k], l2s_[l][k]);
             }
         }
+    };
 
-        if (basis == l) // return with B-spline control points
+    for (ii w = 0; w < ii(synthesisSchedule_.size()); w++)
+    {
+        vector<ii> wave;
+        for (ii i = 0; i < ii(synthesisSchedule_[w].size()); i++)
         {
-            for (ii k = 0; k < ii(xEs[l].size()); k++)
-                f[k].swap(xEs[l][k]);
-
-            break;
+            if (synthesisSchedule_[w][i] > basis) // not needed for the B-spline control points of 'basis'
+                wave.push_back(synthesisSchedule_[w][i]);
         }
 
-        if (l > 0)
+        // the first basis in the wave to reach each parent accumulates into it directly and its siblings into buffers
+        // of their own, which are then added to the parent in decreasing index order
+        vector<char> direct(wave.size(), 1);
+        for (ii i = 0; i < ii(wave.size()); i++)
         {
-            ii pi = bases_[l]->getParentIndex();
-            
-            if (!xEs[pi].size() && !bases_[pi]->isTransient())
+            controlPoints(wave[i]);
+
+            if (wave[i] > 0)
             {
-                xEs[pi].resize(xs_[pi].size());
+                ii pi = bases_[wave[i]]->getParentIndex();
+                controlPoints(pi);
 
-                if (l2s_.size())
+                for (ii j = 0; j < i && direct[i]; j++)
                 {
-                    for (ii k = 0; k < ii(xEs[pi].size()); k++)
-                        xEs[pi][k].divNonzeros(xs_[pi][k], l2s_[pi][k]);
+                    if (wave[j] > 0 && bases_[wave[j]]->getParentIndex() == pi)
+                        direct[i] = 0;
                 }
             }
-
-            bases_[l]->synthesize(xEs[pi], xEs[l], !bases_[pi]->isTransient());
         }
-        else
+
+        vector< vector<MatrixSparse> > buffers(wave.size());
+        execute(ii(wave.size()), [&](ii i)
         {
-            bases_[0]->synthesize(f, xEs[0], false);
+            ii l = wave[i];
+
+            if (l > 0)
+            {
+                ii pi = bases_[l]->getParentIndex();
+
+                if (direct[i])
+                    bases_[l]->synthesize(xEs[pi], xEs[l], !bases_[pi]->isTransient());
+                else
+                    bases_[l]->synthesize(buffers[i], xEs[l], false);
+            }
+            else if (observations)
+            {
+                bases_[0]->synthesizeObservations(f, xEs[0], false, observations);
+            }
+            else
+            {
+                bases_[0]->synthesize(f, xEs[0], false);
+            }
+        });
+
+        for (ii i = 0; i < ii(wave.size()); i++)
+        {
+            if (!direct[i])
+            {
+                ii pi = bases_[wave[i]]->getParentIndex();
+
+                // swapped in rather than resized, as resizing would shallow copy the parent's matrices
+                if (!xEs[pi].size())
+                {
+                    xEs[pi].swap(buffers[i]);
+                }
+                else
+                {
+                    assert(xEs[pi].size() == buffers[i].size());
+
+                    for (ii k = 0; k < ii(buffers[i].size()); k++)
+                        xEs[pi][k].add(buffers[i][k]);
+                }
+            }
         }
     }
+
+    if (basis >= 0) // return with B-spline control points
+    {
+        controlPoints(basis);
+
+        for (ii k = 0; k < ii(xEs[basis].size()); k++)
+            f[k].swap(xEs[basis][k]);
+    }
 }
 
 
@@ -400,42 +613,28 @@ void OptimizerSrl::analyze(std::vector<std::vector<MatrixSparse> > &xEs, std::ve
     if (xEs.size() != bases_.size())
         xEs.resize(bases_.size());
 
-    vector<MatrixSparse> t;
-    bases_.front()->analyze(t, fE, l2);
-
-    if (xEs[0].size() != t.size())
-    {
-        xEs[0].resize(t.size());
-        for (ii k = 0; k < ii(xEs[0].size()); k++)
-            xEs[0][k].swap(t[k]);
-    }
-    else
+    for (ii w = 0; w < ii(analysisSchedule_.size()); w++)
     {
-        for (ii k = 0; k < ii(xEs[0].size()); k++)
-        {
-            xEs[0][k].swap(t[k]);
-            /*xEs[0][k].copySubset(t[k]);
-            if (t[k].nnz() != xEs[0][k].nnz())
-            {
-                cout << "input  0[" << k << "]: " << t[k] << endl;
-                cout << "output 0[" << k << "]: " << xEs[0][k] << endl << endl;
-            }*/
-       }
-    }
-
-    for (ii l = 1; l < ii(bases_.size()); l++)
-    {
-        vector<MatrixSparse> t;
-        bases_[l]->analyze(t, xEs[bases_[l]->getParentIndex()], l2);
+        const vector<ii>& wave = analysisSchedule_[w];
 
-        if (xEs[l].size() != t.size())
+        // siblings read their parent at the same time, so it is sorted and given its MKL handle beforehand
+        for (ii i = 0; i < ii(wave.size()); i++)
         {
-            xEs[l].resize(t.size());
-            for (ii k = 0; k < ii(xEs[l].size()); k++)
-                xEs[l][k].swap(t[k]);
+            const vector<MatrixSparse>& parent = wave[i] > 0 ? xEs[bases_[wave[i]]->getParentIndex()] : fE;
+            for (ii k = 0; k < ii(parent.size()); k++)
+                parent[k].prepareConcurrentReads();
         }
-        else
+
+        execute(ii(wave.size()), [&](ii i)
         {
+            ii l = wave[i];
+
+            vector<MatrixSparse> t;
+            bases_[l]->analyze(t, l > 0 ? xEs[bases_[l]->getParentIndex()] : fE, l2);
+
+            if (xEs[l].size() != t.size())
+                xEs[l].resize(t.size());
+
             for (ii k = 0; k < ii(xEs[l].size()); k++)
             {
                 xEs[l][k].swap(t[k]);
@@ -446,8 +645,8 @@ void OptimizerSrl::analyze(std::vector<std::vector<MatrixSparse> > &xEs, std::ve
                     cout << "output " << l << "[" << k << "]: " << xEs[l][k] << endl << endl;
                 }*/
             }
-        }
-   }
+        });
+    }
 
     for (ii l = 0; l < ii(bases_.size()); l++)
     {
@@ -482,6 +681,61 @@ void OptimizerSrl::analyze(std::vector<std::vector<MatrixSparse> > &xEs, std::ve
 }
 
 
+void OptimizerSrl::execute(ii width, const function<void(ii)>& task) const
+{
+    // trace output is only in order if the tasks run one at a time
+    bool concurrent = width > 1 && getDebugLevel() % 10 < 2;
+
+#if defined(_OPENMP)
+    // the tasks share the threads, each running its own kernels with its share. Nesting is only enabled for the wave,
+    // so the OpenMP settings of the host program are left as they were
+    int threads = omp_get_max_threads();
+    int teams = concurrent ? min(int(width), threads) : 1;
+    int levels = omp_get_max_active_levels();
+    if (concurrent && levels < 2)
+        omp_set_max_active_levels(2);
+#endif
+
+    exception_ptr error;
+
+    #pragma omp parallel num_threads(teams) if (concurrent)
+    {
+#if defined(_OPENMP)
+        int previous = omp_get_max_threads();
+        if (concurrent)
+            omp_set_num_threads(max(1, threads / teams));
+#endif
+
+        #pragma omp for schedule(dynamic, 1)
+        for (ii i = 0; i < width; i++)
+        {
+            try
+            {
+                task(i);
+            }
+            catch (...)
+            {
+                #pragma omp critical
+                if (!error)
+                    error = current_exception();
+            }
+        }
+
+#if defined(_OPENMP)
+        if (concurrent)
+            omp_set_num_threads(previous);
+#endif
+    }
+
+#if defined(_OPENMP)
+    omp_set_max_active_levels(levels);
+#endif
+
+    if (error)
+        rethrow_exception(error);
+}
+
+
 ii OptimizerSrl::getIteration() const
 {
     return iteration_;
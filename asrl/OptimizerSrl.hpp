@@ -25,12 +25,14 @@
 
 
 #include "Optimizer.hpp"
+#include <functional>
 
 
 class OptimizerSrl : public Optimizer
 {
 public:
-    OptimizerSrl(const std::vector<Basis*>& bases, const std::vector<Matrix>& b, bool seed = true, fp pruneThreshold = (fp)0.001);
+    OptimizerSrl(const std::vector<Basis*>& bases, const std::vector<Matrix>& b, bool seed = true, fp pruneThreshold = (fp)0.001,
+                 MatrixSparse::Precision precision = MatrixSparse::Precision::Single);
     virtual ~OptimizerSrl();
 
     virtual void setLambda(fp lambda, fp lambdaGroup = fp(0.0));
@@ -39,6 +41,12 @@ public:
 
     virtual fp step();
 
+    // stop updating each observation (i.e. row of b) once it has converged to tolerance, re-checking them all every
+    // 'interval' iterations (0 never freezes). Row i of the coefficients of every basis must belong to observation i
+    // alone (e.g. an ASRL fit of several rows), so the first basis cannot be transient. A frozen observation keeps its
+    // coefficients and has converged when their relative change is within tolerance
+    void setFreezing(fp tolerance, ii interval);
+
     virtual void synthesize(std::vector<MatrixSparse> &f, std::vector< std::vector<MatrixSparse> >& xEs, ii basis = -1);
     virtual void analyze(std::vector< std::vector<MatrixSparse> > &xEs, std::vector<MatrixSparse> &fE, bool l2, bool l2Normalize = true) const;
 
@@ -47,9 +55,22 @@ public:
     std::vector< std::vector<MatrixSparse> >& l1l2s();
 
 private:
+    // as synthesize, but only the observations (i.e. rows of b, counting through each b[k] in turn) with observations set
+    // are needed (all if 0)
+    void synthesize(std::vector<MatrixSparse> &f, std::vector< std::vector<MatrixSparse> >& xEs, ii basis, const std::vector<char>* observations);
+
+    // calls task(i) for i in [0, width) concurrently, e.g. for the bases of a wave of the schedule
+    void execute(ii width, const std::function<void(ii)>& task) const;
+
     const std::vector<Basis*>& bases_;
     const std::vector<Matrix>& b_;
     fp pruneThreshold_;
+    MatrixSparse::Precision precision_; // storage precision of l2s_ and l1l2sPlusLambda_
+    fp freezeTolerance_;
+    ii freezeInterval_; // re-check frozen observations every this many iterations, 0 never freeze
+    std::vector<char> frozen_; // 1 for each observation not being updated
+    std::vector<double> observationSumSqrs_; // sum(x^2) over each observation's coefficients when last updated
+    std::vector<double> observationSumSqrDiffs_; // and the sum of their squared changes
 
     fp lambda_;
     fp lambdaGroup_;
@@ -58,6 +79,9 @@ private:
     std::vector< std::vector<MatrixSparse> > xs_;
     std::vector< std::vector<MatrixSparse> > l2s_;
     std::vector< std::vector<MatrixSparse> > l1l2sPlusLambda_;
+
+    std::vector< std::vector<ii> > analysisSchedule_; // bases grouped into waves, each only needing the waves before it
+    std::vector< std::vector<ii> > synthesisSchedule_; // with each wave in decreasing index order
     
     double synthesisDuration_;
     double errorDuration_;
@@ -50,6 +50,8 @@ int main(int argc, const char * const * argv)
         int toleranceExponent;
         int debugLevel;
         bool noTaperLambda;
+        bool preserveAcceleration;
+        int freezeInterval;
 
         general.add_options()
                 ("help,h",
@@ -63,8 +65,15 @@ int main(int argc, const char * const * argv)
                  "Ignored if no groups are specified in the input. Use around 0.")
                 ("no_taper", po::bool_switch(&noTaperLambda)->default_value(false),
                  "Use this to stop tapering of lambda to 0 before finishing.")
+                ("preserve_acceleration", po::bool_switch(&preserveAcceleration)->default_value(false),
+                 "Use this to carry the acceleration history through each lambda taper step rather than restarting it.")
                 ("tol,t", po::value<int>(&toleranceExponent)->default_value(-15),
                  "Convergence tolerance, given as \"gradient <= 2^tol\". Use around -15.")
+                ("freeze", po::value<int>(&freezeInterval)->default_value(0),
+                 "Use this to stop updating each row of Xt once it has converged, re-checking all of them every this many "
+                 "iterations. Only worth trying when a few rows converge much later than the rest: on our test data "
+                 "(32 rows of differing scale) the rows converged together and freezing cost 5-35% more time for the "
+                 "same 15 iterations. 0 updates every row throughout.")
                 ("debug,d", po::value<int>(&debugLevel)->default_value(0),
                  "Debug level. Use 1+ for convergence stats, 2+ for performance stats, 3+ for sparsity info, "
                  "4 to output all maths, +10 to write intermediate results to disk.")
@@ -131,7 +140,7 @@ int main(int argc, const char * const * argv)
         string fileStemOut = boost::filesystem::path(filePath).stem().string();
 
         // optimise!
-        Asrl asrl(input, lambda, lambdaGroup, !noTaperLambda, tolerance);
+        Asrl asrl(input, lambda, lambdaGroup, !noTaperLambda, tolerance, preserveAcceleration, freezeInterval);
         do
         {
             if (debugLevel >= 10)
@@ -21,11 +21,12 @@
 
 
 #include "BasisBspline.hpp"
-
+#include <kernel.hpp>
 #include <iostream>
 
 
 using namespace std;
+using namespace kernel;
 
 
 BasisBspline::BasisBspline(std::vector<Basis*>& bases, char dimensions, bool transient, int parentIndex)
@@ -62,12 +63,13 @@ BasisBspline::GridInfo::~GridInfo()
 
 ii BasisBspline::GridInfo::m() const
 {
-    ii m = count;
+    li m = count;
     for (ii i = 1; i < dimensions; i++)
     {
         m *= extent[i];
     }
-    return m;
+    checkIndex(m, "GridInfo");
+    return ii(m);
 }
 
 
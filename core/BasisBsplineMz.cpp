@@ -21,7 +21,6 @@
 
 
 #include "BasisBsplineMz.hpp"
-#include "Bspline.hpp"
 #include <limits>
 #include <iomanip>
 #include <cmath>
@@ -31,8 +30,8 @@ using namespace kernel;
 
 
 BasisBsplineMz::BasisBsplineMz(std::vector<Basis*>& bases, const std::vector<fp>& binCounts, const std::vector<li>& binCountsIndex,
-                               const std::vector<double>& binEdges, char scale, bool transient, int order)
-    : BasisBspline(bases, 1, transient)
+                               const std::vector<double>& binEdges, char scale, bool transient, int order, bool matrixFree)
+    : BasisBspline(bases, 1, transient), bspline_(order, 65536), order_(order)
 {
     if (getDebugLevel() % 10 >= 2)
     {
@@ -43,6 +42,7 @@ BasisBsplineMz::BasisBsplineMz(std::vector<Basis*>& bases, const std::vector<fp>
         else
             oss << "   BasisBsplineMz";
         if (isTransient()) oss << " (transient)";
+        if (matrixFree) oss << " (matrix free)";
         oss << " ...";
         info(oss.str());
     }
@@ -119,60 +119,56 @@ BasisBsplineMz::BasisBsplineMz(std::vector<Basis*>& bases, const std::vector<fp>
         info(oss3.str());
     }
    
-    aTs_.resize(bei.size() - 1);
-    as_.resize(bei.size() - 1);
-    
-    Bspline bspline(order, 65536); // bspline basis function lookup table
+    // A has one block per spectrum and one row per bin
+    vector<ii> ms(bei.size() - 1);
+    vector<ii> ns(bei.size() - 1);
     for (ii k = 0; k < (ii)bei.size() - 1; k++)
     {
-        vector<ii> rowind;
-        vector<ii> colind;
-        vector<fp> acoo;
+        ms[k] = (ii)(bci[k + 1] - bci[k]);
+        ns[k] = getGridInfo().n();
+    }
 
-        for (ii i = bei[k]; i < bei[k + 1] - 1; i++)
+    // the bin edges in units of basis functions are all that is needed to evaluate A
+    offset_ = gridInfo().offset[0];
+    bei_ = bei;
+    binEdges_.resize(binEdges.size());
+    for (size_t i = 0; i < binEdges.size(); i++)
+        binEdges_[i] = binEdges[i] * bpi;
+    for (ii k = 0; k < (ii)bei.size() - 1; k++)
+    {
+        for (ii i = 0; i < ms[k]; i++)
         {
-            if (binCounts[i - bei[k] + bci[k]] >= 0.0)
+            if (binCounts[bci[k] + i] < 0.0)
             {
-                double xfMin = binEdges[i] * bpi;
-                double xfMax = binEdges[i + 1] * bpi;
-
-                ii xMin = (ii)floor(xfMin);
-                ii xMax = ((ii)ceil(xfMax)) + order;
-
-                // work out basis coefficients
-                for (ii x = xMin; x < xMax; x++)
-                {
-                    double bfMin = (double)(x - order);
-                    double bfMax = (double)(x + 1);
-
-                    // intersection of bin and basis, between 0 and order+1
-                    double bMin = xfMin > bfMin ? xfMin - bfMin : 0.0;
-                    double bMax = xfMax < bfMax ? xfMax - bfMin : bfMax - bfMin;
-
-                    // basis coefficient b is _integral_ of area under b-spline basis
-                    fp b = (fp)(bspline.ibasis(bMax) - bspline.ibasis(bMin));
-
-                    acoo.push_back(b);
-                    rowind.push_back(i - bei[k]);
-                    colind.push_back(x - gridInfo().offset[0]);
-                }
+                isBinIgnored_.resize(binEdges_.size(), false);
+                isBinIgnored_[bei[k] + i] = true;
             }
         }
-        
-        // create A
-        aTs_[k].copy(getGridInfo().n(), bci[k + 1] - bci[k], acoo.size(), colind.data(), rowind.data(), acoo.data());
-        as_[k].copy(aTs_[k], true);
+    }
 
-        // display progress update
-        if (getDebugLevel() % 10 >= 2)
-        {
-            if ((k + 1) % 100 == 0 || k == (ii)bei.size() - 2)
-            {
-                ostringstream oss;
-                oss << getTimeStamp() << "     " << setw(1 + (int)(log10((float)bci.size() - 1))) << (k + 1) << "/" << (bci.size() - 1);
-                info(oss.str());
-            }
-        }
+    if (matrixFree)
+    {
+        // A is never stored, each row is evaluated from the bin edges whenever it is needed
+        a_.copyImplicit(ms, ns,
+            [&](ii k, ii i) { return countRow(k, i); },
+            [this](ii k, ii i, ii* js, fp* vs) { return fillRow(k, i, js, vs); });
+    }
+    else
+    {
+        a_.copyRows(ms, ns,
+            [&](ii k, ii i) { return countRow(k, i); },
+            [&](ii k, ii i, ii* js, fp* vs) { fillRow(k, i, js, vs); });
+        aT_.copy(a_, true);
+
+        // each row of both is a run of consecutive bins or coefficients, so their column indices compress well, and with
+        // regularly spaced bins so do their values
+        a_.compress();
+        a_.compressValues();
+        aT_.compress();
+        aT_.compressValues();
+
+        vector<double>().swap(binEdges_);
+        vector<bool>().swap(isBinIgnored_);
     }
 
     if (scaleAuto != scale && getDebugLevel() % 10 >= 2)
@@ -189,6 +185,47 @@ BasisBsplineMz::~BasisBsplineMz()
 }
 
 
+ii BasisBsplineMz::countRow(ii k, ii i) const
+{
+    if (!isBinIgnored_.empty() && isBinIgnored_[bei_[k] + i])
+        return 0;
+
+    ii xMin = (ii)floor(binEdges_[bei_[k] + i]);
+    ii xMax = ((ii)ceil(binEdges_[bei_[k] + i + 1])) + order_;
+    return xMax - xMin;
+}
+
+
+ii BasisBsplineMz::fillRow(ii k, ii i, ii* js, fp* vs) const
+{
+    if (!isBinIgnored_.empty() && isBinIgnored_[bei_[k] + i])
+        return 0;
+
+    double xfMin = binEdges_[bei_[k] + i];
+    double xfMax = binEdges_[bei_[k] + i + 1];
+
+    ii xMin = (ii)floor(xfMin);
+    ii xMax = ((ii)ceil(xfMax)) + order_;
+
+    // work out basis coefficients
+    for (ii x = xMin; x < xMax; x++)
+    {
+        double bfMin = (double)(x - order_);
+        double bfMax = (double)(x + 1);
+
+        // intersection of bin and basis, between 0 and order+1
+        double bMin = xfMin > bfMin ? xfMin - bfMin : 0.0;
+        double bMax = xfMax < bfMax ? xfMax - bfMin : bfMax - bfMin;
+
+        // basis coefficient b is _integral_ of area under b-spline basis
+        js[x - xMin] = x - offset_;
+        vs[x - xMin] = (fp)(bspline_.ibasis(bMax) - bspline_.ibasis(bMin));
+    }
+
+    return xMax - xMin;
+}
+
+
 void BasisBsplineMz::synthesize(vector<MatrixSparse> &f, const vector<MatrixSparse> &x, bool accumulate)
 {
     if (getDebugLevel() % 10 >= 3)
@@ -199,38 +236,44 @@ void BasisBsplineMz::synthesize(vector<MatrixSparse> &f, const vector<MatrixSpar
     }
 
     if (!f.size())
-        f.resize(aTs_.size());
+        f.resize(a_.count());
 
-    for (size_t k = 0; k < aTs_.size(); k++)
+    // prune basis functions that are no longer needed
+    ii rowsPruned;
+    if (a_.isImplicit())
     {
-        MatrixSparseView row(x[0], k);
-
-        // prune basis functions that are no longer needed
-        MatrixSparse t;
-        ii rowsPruned = t.copyPruneRows(aTs_[k], row, false, 0.75);
+        rowsPruned = a_.pruneColumns(x[0], 0.75);
+    }
+    else
+    {
+        // the analysis operator only masks the same basis functions, being rebuilt once half its non-zeros are masked
+        rowsPruned = aT_.pruneRows(x[0], 0.75);
         if (rowsPruned > 0)
-        {
-            aTs_[k].swap(t);
-            as_[k].copy(aTs_[k], true);
-
-            if (getDebugLevel() % 10 >= 3)
-            {
-                ostringstream oss;
-                oss << getTimeStamp() << "      " << getIndex() << " pruned " << rowsPruned << " basis functions";
-                info(oss.str());
-            }
-        }
-
-        // synthesise with dense result
-        f[k].matmul(false, row, aTs_[k], accumulate, true);
+            a_.maskColumns(aT_, 0.5);
+    }
 
+    if (rowsPruned > 0)
+    {
         if (getDebugLevel() % 10 >= 3)
         {
             ostringstream oss;
-            oss << getTimeStamp() << "       " << f[k];
+            oss << getTimeStamp() << "      " << getIndex() << " pruned " << rowsPruned << " basis functions";
             info(oss.str());
         }
     }
+
+    // synthesise with dense results
+    if (a_.isImplicit())
+        a_.matmulRows(f, x[0], accumulate, true);
+    else
+        aT_.matmulRows(f, x[0], accumulate, false);
+
+    if (getDebugLevel() % 10 >= 3)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       " << f[0] << " x " << f.size();
+        info(oss.str());
+    }
 }
 
 
@@ -243,23 +286,9 @@ void BasisBsplineMz::analyze(vector<MatrixSparse> &xE, const vector<MatrixSparse
         info(oss.str());
     }
 
-    vector<MatrixSparse> xEs(aTs_.size());
-    for (size_t k = 0; k < aTs_.size(); k++)
-    {
-        if (sqrA)
-        {
-            MatrixSparse aSqr;
-            aSqr.sqr(as_[k]);
-            xEs[k].matmul(false, fE[k], aSqr, false);
-        }
-        else
-        {
-            xEs[k].matmul(false, fE[k], as_[k], false);
-        }
-    }
-    
+    // analyse all spectra straight into the concatenated result
     xE.resize(1);
-    xE[0].copyConcatenate(xEs);
+    a_.matmulRows(xE[0], fE, sqrA);
 
     if (getDebugLevel() % 10 >= 3)
     {
@@ -270,4 +299,29 @@ void BasisBsplineMz::analyze(vector<MatrixSparse> &xE, const vector<MatrixSparse
 }
 
 
+bool BasisBsplineMz::analyzeNorms(vector<MatrixSparse> &l1s, vector<MatrixSparse> &l2Sqrs, const vector<MatrixSparse> &fL1s, const vector<MatrixSparse> &fL2Sqrs)
+{
+    if (getDebugLevel() % 10 >= 3)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "     " << getIndex() << " BasisBsplineMz::analyseNorms";
+        info(oss.str());
+    }
+
+    // column sums of the basis and its square, without materialising bin-sized vectors of ones
+    l1s.resize(1);
+    l2Sqrs.resize(1);
+    a_.sumColumns(l1s[0], l2Sqrs[0]);
+
+    if (getDebugLevel() % 10 >= 3)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       " << l1s[0] << ", " << l2Sqrs[0];
+        info(oss.str());
+    }
+
+    return true;
+}
+
+
 
@@ -25,21 +25,35 @@
 
 
 #include "BasisBspline.hpp"
+#include "Bspline.hpp"
+#include <MatrixSparseBatch.hpp>
 
 
 class BasisBsplineMz : public BasisBspline
 {
 public:
     BasisBsplineMz(std::vector<Basis*>& bases, const std::vector<fp>& binCounts, const std::vector<li>& binCountsIndex,
-                   const std::vector<double>& binEdges, char scale, bool transient, int order = 3);
+                   const std::vector<double>& binEdges, char scale, bool transient, int order = 3, bool matrixFree = false);
     virtual ~BasisBsplineMz();
 
     virtual void synthesize(std::vector<MatrixSparse> &f, const std::vector<MatrixSparse> &x, bool accumulate);
     virtual void analyze(std::vector<MatrixSparse> &xE, const std::vector<MatrixSparse> &fE, bool sqrA = false);
+    virtual bool analyzeNorms(std::vector<MatrixSparse> &l1s, std::vector<MatrixSparse> &l2Sqrs, const std::vector<MatrixSparse> &fL1s, const std::vector<MatrixSparse> &fL2Sqrs);
 
 private:
-    std::vector<MatrixSparse> aTs_;
-    std::vector<MatrixSparse> as_;
+    ii countRow(ii k, ii i) const; // nnz of row i of the basis matrix of spectrum k
+    ii fillRow(ii k, ii i, ii* js, fp* vs) const; // evaluate row i of the basis matrix of spectrum k, returning its nnz
+
+    MatrixSparseBatch aT_; // one block per spectrum, transposed basis matrix, unused if matrix free
+    MatrixSparseBatch a_;  // one block per spectrum, basis matrix, implicit if matrix free
+
+    // what is needed to evaluate the basis matrix, the bin edges are only kept after construction if matrix free
+    Bspline bspline_;                // b-spline basis function lookup table
+    std::vector<double> binEdges_;   // bin edges of all spectra in units of basis functions
+    std::vector<bool> isBinIgnored_; // indexed as binEdges_, true for bins with negative counts (empty if there are none)
+    std::vector<li> bei_;            // first bin edge of each spectrum
+    ii order_;
+    ii offset_;                      // offset of the basis function grid
 };
 
 
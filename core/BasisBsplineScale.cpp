@@ -75,33 +75,29 @@ BasisBsplineScale(vector<Basis*>& bases, int parentIndex, char dimension, bool t
     for (ii i = 0; i < nh; i++)
         hs[i] /= (fp) sum;
 
-    // create A as a temporary COO matrix
+    // create A directly in CSR, one row per coefficient
     ii m = parentGridInfo.extent[dimension_];
     ii n = gridInfo().extent[dimension_];
-    vector<ii> rowind(nh * n);
-    vector<ii> colind(nh * n);
-    vector<fp> acoo(nh * n);
-
-    ii nnz = 0;
     ii offset = order + ((parentGridInfo.offset[dimension_] + 1) % 2);
-    for (ii j = 0; j < n; j++)
-    {
-        for (ii i = 0; i < nh; i++)
+    aT_.copyRows(n, m,
+        [&](ii j)
         {
-            rowind[nnz] = 2 * j + i - offset;
-            if (rowind[nnz] < 0 || rowind[nnz] >= m) continue;
-            acoo[nnz] = hs[i];
-            colind[nnz] = j;
-
-            nnz++;
-        }
-    }
-
-    // create A
-    aT_.copy(n, m, acoo.size(), colind.data(), rowind.data(), acoo.data());
-
-    if (dimension == 0)
-        a_.copy(aT_, true);
+            ii iMin = max(offset - 2 * j, ii(0));
+            ii iMax = min(m + offset - 2 * j, nh);
+            return iMax > iMin ? iMax - iMin : ii(0);
+        },
+        [&](ii j, ii* js, fp* vs)
+        {
+            ii iMin = max(offset - 2 * j, ii(0));
+            ii iMax = min(m + offset - 2 * j, nh);
+            for (ii i = iMin; i < iMax; i++)
+            {
+                js[i - iMin] = 2 * j + i - offset;
+                vs[i - iMin] = hs[i];
+            }
+        });
+
+    a_.copy(aT_, true);
 }
 
 
@@ -125,14 +121,10 @@ synthesize(vector<MatrixSparse> &f, const vector<MatrixSparse> &x, bool accumula
         f.resize(1);
 
     // zero basis functions that are no longer needed
-    MatrixSparse t;
-    ii rowsPruned = t.copyPruneRows(aT_, x[0], dimension_ > 0, 0.75);
+    ii rowsPruned = aT_.pruneRows(x[0], dimension_ > 0, 0.75);
     if (rowsPruned > 0)
     {
-        aT_.swap(t);
-
-        if (dimension_ == 0)
-            a_.copy(aT_, true);
+        a_.pruneColumns(aT_);
 
         if (getDebugLevel() % 10 >= 3)
         {
@@ -142,11 +134,11 @@ synthesize(vector<MatrixSparse> &f, const vector<MatrixSparse> &x, bool accumula
         }
     }
 
-    // synthesise
+    // synthesise, in scan-time each row of f is a weighted sum of a few rows of x, streamed in m/z tiles
     if (dimension_ == 0)
         f[0].matmul(false, x[0], aT_, accumulate);
     else
-        f[0].matmul(true, aT_, x[0], accumulate);
+        f[0].matmulBand(a_, x[0], accumulate);
 
     if (getDebugLevel() % 10 >= 3)
     {
@@ -157,6 +149,23 @@ synthesize(vector<MatrixSparse> &f, const vector<MatrixSparse> &x, bool accumula
 }
 
 
+void BasisBsplineScale::refine(MatrixSparse& f, const MatrixSparse& x) const
+{
+    if (getDebugLevel() % 10 >= 3)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "     " << getIndex() << " BasisBsplineScale::refine";
+        info(oss.str());
+    }
+
+    // as synthesize, but without pruning our basis functions where x is zero
+    if (dimension_ == 0)
+        f.matmul(false, x, aT_, false);
+    else
+        f.matmulBand(a_, x, false);
+}
+
+
 void BasisBsplineScale::analyze(vector<MatrixSparse> &xE, const vector<MatrixSparse> &fE, bool sqrA)
 {
     if (getDebugLevel() % 10 >= 3)
@@ -180,10 +189,7 @@ void BasisBsplineScale::analyze(vector<MatrixSparse> &xE, const vector<MatrixSpa
         }
         else
         {
-            MatrixSparse t;
-            t.sqr(aT_);
-
-            xE[0].matmul(false, t, fE[0], false);
+            xE[0].matmulBand(aT_, fE[0], false, true);
         }
     }
     else
@@ -191,7 +197,7 @@ void BasisBsplineScale::analyze(vector<MatrixSparse> &xE, const vector<MatrixSpa
         if (dimension_ == 0)
             xE[0].matmul(false, fE[0], a_, false);
         else
-            xE[0].matmul(false, aT_, fE[0], false);
+            xE[0].matmulBand(aT_, fE[0], false);
     }
 
     if (getDebugLevel() % 10 >= 3)
@@ -36,6 +36,9 @@ public:
     virtual void synthesize(std::vector<MatrixSparse> &f, const std::vector<MatrixSparse> &x, bool accumulate);
     virtual void analyze(std::vector<MatrixSparse> &xE, const std::vector<MatrixSparse> &fE, bool sqrA = false);
 
+    // control points f at our parent's scale from control points x at ours, i.e. the b-spline two-scale relation
+    void refine(MatrixSparse& f, const MatrixSparse& x) const;
+
 private:
     MatrixSparse aT_;
     MatrixSparse a_;
@@ -95,40 +95,42 @@ BasisBsplineScantime::BasisBsplineScantime(std::vector<Basis*>& bases, ii parent
         info(oss.str());
     }
 
-    // populate coo matrix
-    vector<ii> rowind;
-    vector<ii> colind;
-    vector<fp> acoo;
+    // create A directly in CSR, one row per spectrum
     Bspline bspline(order, 65536); // bspline basis function lookup table
-    for (ii i = 0; i < startTimes.size(); i++)
-    {
-        double xfMin = startTimes[i] * bpi;
-        double xfMax = finishTimes[i] * bpi;
-
-        ii xMin = (ii) floor(xfMin);
-        ii xMax = ((ii) ceil(xfMax)) + order;
-        
-        // work out basis coefficients
-        for (int x = xMin; x < xMax; x++)
+    ii offset = gridInfo().offset[1];
+    a_.copyRows(parentGridInfo.m(), getGridInfo().m(),
+        [&](ii i)
         {
-            double bfMin = (double)(x - order);
-            double bfMax = (double)(x + 1);
-            
-            // intersection of bin and basis, between 0 and order+1
-            double bMin = xfMin > bfMin ? xfMin - bfMin : 0.0;
-            double bMax = xfMax < bfMax ? xfMax - bfMin : bfMax - bfMin;
-
-            // basis coefficient b is _integral_ of area under b-spline basis
-            fp b = exposures[i] * fp(bspline.ibasis(bMax) - bspline.ibasis(bMin));
-
-            rowind.push_back(i);
-            colind.push_back(x - gridInfo().offset[1]);
-            acoo.push_back(b);
-        }
-    }
+            ii xMin = (ii)floor(startTimes[i] * bpi);
+            ii xMax = ((ii)ceil(finishTimes[i] * bpi)) + order;
+            return xMax - xMin;
+        },
+        [&](ii i, ii* js, fp* vs)
+        {
+            double xfMin = startTimes[i] * bpi;
+            double xfMax = finishTimes[i] * bpi;
+
+            ii xMin = (ii)floor(xfMin);
+            ii xMax = ((ii)ceil(xfMax)) + order;
+
+            // work out basis coefficients
+            for (ii x = xMin; x < xMax; x++)
+            {
+                double bfMin = (double)(x - order);
+                double bfMax = (double)(x + 1);
+
+                // intersection of bin and basis, between 0 and order+1
+                double bMin = xfMin > bfMin ? xfMin - bfMin : 0.0;
+                double bMax = xfMax < bfMax ? xfMax - bfMin : bfMax - bfMin;
+
+                // basis coefficient b is _integral_ of area under b-spline basis
+                js[x - xMin] = x - offset;
+                vs[x - xMin] = exposures[i] * fp(bspline.ibasis(bMax) - bspline.ibasis(bMin));
+            }
+        });
 
     // create transformation matrix 'a'
-    aT_.copy(getGridInfo().m(), parentGridInfo.m(), acoo.size(), colind.data(), rowind.data(), acoo.data());
+    aT_.copy(a_, true);
 
     if (scaleAuto != scale)
         cerr << "WARNING: st_scale is not the suggested value of " << scaleAuto << ". Continue at your own risk!";
@@ -153,11 +155,10 @@ void BasisBsplineScantime::synthesize(vector<MatrixSparse> &f, const vector<Matr
         f.resize(1);
 
     // zero basis functions that are no longer needed
-    MatrixSparse t;
-    ii rowsPruned = t.copyPruneRows(aT_, x[0], true, 0.75);
+    ii rowsPruned = aT_.pruneRows(x[0], true, 0.75);
     if (rowsPruned > 0)
     {
-        aT_.swap(t);
+        a_.pruneColumns(aT_);
 
         if (getDebugLevel() % 10 >= 2)
         {
@@ -167,8 +168,8 @@ void BasisBsplineScantime::synthesize(vector<MatrixSparse> &f, const vector<Matr
         }
     }
 
-    // synthesise
-    f[0].matmul(true, aT_, x[0], accumulate);
+    // synthesise, each spectrum is a weighted sum of the few rows of coefficients whose basis functions overlap it
+    f[0].matmulBand(a_, x[0], accumulate);
         
     if (getDebugLevel() % 10 >= 3)
     {
@@ -191,17 +192,8 @@ void BasisBsplineScantime::analyze(vector<MatrixSparse> &xE, const vector<Matrix
     if (!xE.size())
         xE.resize(1);
 
-    if (sqrA)
-    {
-        MatrixSparse t;
-        t.sqr(aT_);
-        xE[0].matmul(false, t, fE[0], false);
-    }
-    else
-    {
-        xE[0].matmul(false, aT_, fE[0], false);
-    }
-    
+    xE[0].matmulBand(aT_, fE[0], false, sqrA);
+
     if (getDebugLevel() % 10 >= 3)
     {
         ostringstream oss;
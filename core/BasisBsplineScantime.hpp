@@ -38,7 +38,8 @@ public:
     virtual void analyze(std::vector<MatrixSparse> &xE, const std::vector<MatrixSparse> &fE, bool sqrA = false);
 
 private:
-    MatrixSparse aT_;
+    MatrixSparse a_;  // one row per spectrum, a narrow band of scan-time basis functions
+    MatrixSparse aT_; // transpose of a_, one row per scan-time basis function
 };
 
 
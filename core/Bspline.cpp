@@ -38,7 +38,7 @@ Bspline::Bspline(ii order, ii n)
 }
 
 
-double Bspline::ibasis(double x)
+double Bspline::ibasis(double x) const
 {
 	if (x >= order_ + 1)
 	{
@@ -32,7 +32,7 @@ class Bspline
 {
 public:
     Bspline(ii order, ii n);
-    double ibasis(double x);
+    double ibasis(double x) const;
 
     static double m(double x, ii k, ii i, std::vector<fp>& ks);
     static double m(double x, ii k, ii i);
@@ -24,8 +24,9 @@
 #include "BasisBsplineMz.hpp"
 #include "BasisBsplineScale.hpp"
 #include "BasisBsplineScantime.hpp"
-#include "../asrl/OptimizerAccelerationEve1.hpp"
 #include <kernel.hpp>
+#include <cassert>
+#include <cmath>
 #include <cstring>
 #include <iomanip>
 #include <sstream>
@@ -41,15 +42,65 @@ void Seamass::notice()
 }
 
 
-Seamass::Seamass(const Input& input, const std::vector<char>& scale, fp lambda, bool taperShrinkage, fp tolerance) : lambda_(lambda), lambdaStart_(lambda), taperShrinkage_(taperShrinkage), tolerance_(tolerance), iteration_(0)
+Seamass::Seamass(const Input& input, const std::vector<char>& scale, fp lambda, bool taperShrinkage, fp tolerance, MatrixSparse::Precision precision, bool validatePrecision, bool matrixFree, OptimizerAcceleration::Type acceleration, bool preserveAcceleration, char cascade) : lambda_(lambda), lambdaStart_(lambda), taperShrinkage_(taperShrinkage), tolerance_(tolerance), iteration_(0), validation_(0)
 {
-    init(input, scale, true);
+    init(input, scale, true, precision, matrixFree, acceleration, preserveAcceleration);
+
+    if (validatePrecision && precision != MatrixSparse::Precision::Single)
+    {
+        if (getDebugLevel() % 10 >= 1)
+        {
+            ostringstream oss;
+            oss << getTimeStamp() << "  Initialising full precision twin for validation ...";
+            info(oss.str());
+        }
+
+        // the twin does not cascade itself, but is warm started from our coarse fit below
+        validation_ = new Seamass(input, scale, lambda, taperShrinkage, tolerance, MatrixSparse::Precision::Single, false, matrixFree, acceleration, preserveAcceleration, 0);
+    }
+
+    // fit one scale coarser in each dimension (itself cascading further) at the starting lambda, and warm start from it.
+    // The warm start only needs the rough shape of the solution, so the coarse fit stops early
+    const fp coarseLoosening = fp(16.0);
+    const ii coarseIterations = 8;
+
+    vector<char> coarseScale = static_cast<BasisBspline*>(bases_[dimensions_ - 1])->getGridInfo().scale;
+    for (ii i = 0; i < (ii)coarseScale.size(); i++)
+        coarseScale[i]--;
+    if (cascade > 0 && coarseScale[0] >= -6)
+    {
+        if (getDebugLevel() % 10 >= 1)
+        {
+            ostringstream oss;
+            oss << getTimeStamp() << "  Fitting at coarser scale for warm start ...";
+            info(oss.str());
+        }
+
+        double startTime = getElapsedTime();
+
+        Seamass coarse(input, coarseScale, lambda, false, tolerance * coarseLoosening, precision, false, matrixFree, acceleration, preserveAcceleration, cascade - 1);
+        while (coarse.getIteration() < coarseIterations && coarse.step());
+
+        warmStart(coarse);
+        if (validation_)
+            validation_->warmStart(coarse);
+
+        if (getDebugLevel() % 10 >= 1)
+        {
+            // the whole cost of the cascade, including building the coarse trees, so it can be weighed against the
+            // iterations it saves
+            ostringstream oss;
+            oss << getTimeStamp() << "  Warm started from " << coarse.getIteration() << " coarse iterations in ";
+            oss << fixed << setprecision(3) << getElapsedTime() - startTime << " seconds";
+            info(oss.str());
+        }
+    }
 }
 
 
-Seamass::Seamass(const Input& input, const Output& seed) : lambda_(seed.shrinkage), lambdaStart_(seed.shrinkage), tolerance_(seed.tolerance), iteration_(0)
+Seamass::Seamass(const Input& input, const Output& seed) : lambda_(seed.shrinkage), lambdaStart_(seed.shrinkage), tolerance_(seed.tolerance), iteration_(0), validation_(0)
 {
-    init(input, seed.scale, false);
+    init(input, seed.scale, false, MatrixSparse::Precision::Single, false, OptimizerAcceleration::Type::Eve1, false);
 
     // import seed
     for (ii k = 0; k < (ii)bases_.size(); k++)
@@ -71,6 +122,7 @@ Seamass::Seamass(const Input& input, const Output& seed) : lambda_(seed.shrinkag
 
 Seamass::~Seamass()
 {
+    delete validation_;
     delete optimizer_;
     delete innerOptimizer_;
 
@@ -79,7 +131,8 @@ Seamass::~Seamass()
 }
 
 
-void Seamass::init(const Input& input, const std::vector<char>& scales, bool seed)
+void Seamass::init(const Input& input, const std::vector<char>& scales, bool seed, MatrixSparse::Precision precision, bool matrixFree,
+                   OptimizerAcceleration::Type acceleration, bool preserveAcceleration)
 {
     // for speed only, merge bins if rc_mz is set more than 8 times higher than the bin width
     // this is conservative, 4 times might be ok, but 2 times isn't enough
@@ -97,7 +150,7 @@ void Seamass::init(const Input& input, const std::vector<char>& scales, bool see
     {
         dimensions_ = 1;
 
-        new BasisBsplineMz(bases_, input.counts, input.countsIndex, input.locations, scales[0], false);
+        new BasisBsplineMz(bases_, input.counts, input.countsIndex, input.locations, scales[0], false, 3, matrixFree);
         
         while (static_cast<BasisBspline*>(bases_.back())->getGridInfo().scale[0] > -6)
         {
@@ -108,7 +161,7 @@ void Seamass::init(const Input& input, const std::vector<char>& scales, bool see
     {
         dimensions_ = 2;
 
-        new BasisBsplineMz(bases_, input.counts, input.countsIndex, input.locations, scales[0], true);
+        new BasisBsplineMz(bases_, input.counts, input.countsIndex, input.locations, scales[0], true, 3, matrixFree);
         Basis* previousBasis = new BasisBsplineScantime(bases_, bases_.back()->getIndex(), input.startTimes, input.finishTimes, input.exposures, scales[1], false);
  
         for (ii i = 0; static_cast<BasisBspline*>(bases_.back())->getGridInfo().scale[0] > -6; i++)
@@ -141,12 +194,131 @@ void Seamass::init(const Input& input, const std::vector<char>& scales, bool see
     }
 
     // INIT OPTIMISER
-    innerOptimizer_ = new OptimizerSrl(bases_, b_, seed);
-    optimizer_ = new OptimizerAccelerationEve1(innerOptimizer_);
+    innerOptimizer_ = new OptimizerSrl(bases_, b_, seed, (fp)0.001, precision);
+    OptimizerAcceleration* optimizer = OptimizerAcceleration::create(acceleration, innerOptimizer_, precision);
+    optimizer->setPreserveState(preserveAcceleration);
+    optimizer_ = optimizer;
     optimizer_->setLambda((fp) lambda_);
 }
 
 
+// coefficients x on grid 'from' re-indexed to grid 'to' of the same scale, dropping those outside it. In 1D each row is
+// a spectrum, in 2D a scan-time coefficient
+static void shift(MatrixSparse& y, const BasisBspline::GridInfo& to, const MatrixSparse& x, const BasisBspline::GridInfo& from)
+{
+    ii rowShift = from.dimensions > 1 ? from.offset[1] - to.offset[1] : 0;
+    ii columnShift = from.offset[0] - to.offset[0];
+
+    vector<ii> is(x.nnz());
+    vector<ii> js(x.nnz());
+    vector<fp> xs(x.nnz());
+    x.exportTo(is.data(), js.data(), xs.data());
+
+    ii length = 0;
+    for (ii nz = 0; nz < x.nnz(); nz++)
+    {
+        ii i = is[nz] + rowShift;
+        ii j = js[nz] + columnShift;
+        if (i >= 0 && i < to.m() && j >= 0 && j < to.n())
+        {
+            is[length] = i;
+            js[length] = j;
+            xs[length] = xs[nz];
+            length++;
+        }
+    }
+
+    y.copy(to.m(), to.n(), length, is.data(), js.data(), xs.data());
+}
+
+
+void Seamass::warmStart(const Seamass& coarse)
+{
+    // the fine tree contains every scale of the coarse tree, and as l2 normalised coefficients at the same scale describe
+    // the same functions they carry over directly. The finest scale is new, so a share of the coarse solution is moved
+    // to it by prolonging the coarse control points through the b-spline two-scale relation, leaving f unchanged. Any
+    // other new scales (in 2D, those at the finest m/z or scan-time scale) keep a share of their seed to grow from
+    const fp finestShare = fp(0.5);
+
+    ii finest = dimensions_ - 1;
+    ii coarseFinest = coarse.dimensions_ - 1;
+    const BasisBspline::GridInfo& coarseFinestInfo = static_cast<BasisBspline*>(coarse.bases_[coarseFinest])->getGridInfo();
+
+    // prolong the coarse control points to our finest scale
+    MatrixSparse p;
+    {
+        vector<MatrixSparse> c(1);
+        {
+            vector< vector<MatrixSparse> > cs;
+            coarse.optimizer_->synthesize(c, cs, coarseFinest);
+        }
+
+        ii l = 0;
+        while (l < (ii)bases_.size() && static_cast<BasisBspline*>(bases_[l])->getGridInfo().scale != coarseFinestInfo.scale)
+            l++;
+        if (l == (ii)bases_.size())
+            throw runtime_error("ERROR: coarse scale is missing from the basis tree");
+
+        shift(p, static_cast<BasisBspline*>(bases_[l])->getGridInfo(), c[0], coarseFinestInfo);
+
+        for (; l != finest; l = bases_[l]->getParentIndex())
+        {
+            MatrixSparse t;
+            static_cast<BasisBsplineScale*>(bases_[l])->refine(t, p);
+            p.swap(t);
+        }
+    }
+
+    for (ii l = 0; l < (ii)bases_.size(); l++)
+    {
+        if (!bases_[l]->isTransient())
+        {
+            const BasisBspline::GridInfo& gridInfo = static_cast<BasisBspline*>(bases_[l])->getGridInfo();
+            // a single block of coefficients per basis, as both trees are built by init
+            assert(optimizer_->xs()[l].size() == 1);
+            MatrixSparse& x = optimizer_->xs()[l][0];
+
+            ii lc = 0;
+            while (lc < (ii)coarse.bases_.size() && (coarse.bases_[lc]->isTransient() ||
+                   static_cast<BasisBspline*>(coarse.bases_[lc])->getGridInfo().scale != gridInfo.scale))
+                lc++;
+
+            MatrixSparse t;
+            if (l == finest)
+            {
+                // control points to l2 normalised coefficients
+                t.copySubset(p, x);
+                t.mul(optimizer_->l2s()[l][0]);
+                t.mul(finestShare);
+            }
+            else if (lc < (ii)coarse.bases_.size())
+            {
+                assert(coarse.optimizer_->xs()[lc].size() == 1);
+                MatrixSparse c;
+                shift(c, gridInfo, coarse.optimizer_->xs()[lc][0], static_cast<BasisBspline*>(coarse.bases_[lc])->getGridInfo());
+                t.copySubset(c, x);
+                t.mul(1 - finestShare);
+            }
+            else
+            {
+                t.copy(x);
+                t.mul(finestShare);
+            }
+
+            // only coefficients in both the seed and the warm start remain
+            t.prune();
+            x.swap(t);
+
+            t.copySubset(optimizer_->l2s()[l][0], x);
+            optimizer_->l2s()[l][0].swap(t);
+
+            t.copySubset(optimizer_->l1l2s()[l][0], x);
+            optimizer_->l1l2s()[l][0].swap(t);
+        }
+    }
+}
+
+
 bool Seamass::step()
 {
     if (iteration_ == 0 && getDebugLevel() % 10 >= 1)
@@ -175,6 +347,22 @@ bool Seamass::step()
     iteration_++;
     double grad = optimizer_->step();
 
+    if (validation_)
+    {
+        validation_->iteration_++;
+        double gradValidation = validation_->optimizer_->step();
+
+        if (getDebugLevel() % 10 >= 1)
+        {
+            ostringstream oss;
+            oss << getTimeStamp();
+            oss << "   it: " << setw(5) << iteration_;
+            oss << " fp32 grad: " << fixed << setprecision(8) << setw(10) << gradValidation;
+            oss << " diff: " << scientific << setprecision(3) << grad - gradValidation;
+            info(oss.str());
+        }
+    }
+
     if (getDebugLevel() % 10 >= 1)
     {
         li nnz = 0;
@@ -198,11 +386,54 @@ bool Seamass::step()
         info(oss.str());
     }
 
+    if (getDebugLevel() % 10 >= 2)
+    {
+        // share of the coefficient pages on the NUMA node of the threads that process them. This is page placement, not
+        // measured traffic
+        double localBytes = 0.0;
+        li bytes = 0;
+        for (ii j = 0; j < (ii)bases_.size(); j++)
+        {
+            if (!static_cast<BasisBspline *>(bases_[j])->isTransient())
+            {
+                for (size_t k = 0; k < optimizer_->xs()[j].size(); k++)
+                {
+                    const MatrixSparse& x = optimizer_->xs()[j][k];
+                    if (x.getPrecision() == MatrixSparse::Precision::Single && x.nnz() > 0)
+                    {
+                        li xBytes = sizeof(fp) * (li)x.nnz();
+                        double local = getLocalFraction(x.vs(), xBytes);
+                        if (local >= 0.0)
+                        {
+                            localBytes += local * xBytes;
+                            bytes += xBytes;
+                        }
+                    }
+                }
+            }
+        }
+
+        ostringstream oss;
+        oss << getTimeStamp();
+        oss << "   it: " << setw(5) << iteration_ << " numa pages: ";
+        if (bytes > 0)
+        {
+            oss << fixed << setprecision(1) << 100.0 * localBytes / bytes << "% local ";
+            oss << 100.0 * (1.0 - localBytes / bytes) << "% remote";
+        }
+        else
+        {
+            oss << "unknown";
+        }
+        info(oss.str());
+    }
+
     if (grad <= tolerance_)
     {
         if (lambda_ == 0.0 || !taperShrinkage_)
         {
             if (getDebugLevel() % 10 == 0) cout << "o" << endl;
+            if (validation_) validate();
 
             return false;
         }
@@ -211,6 +442,13 @@ bool Seamass::step()
             if (getDebugLevel() % 10 == 0) cout << "o" << flush;
             lambda_ *= (lambda_ > 0.0625 ? 0.5 : 0.0);
             optimizer_->setLambda((fp) lambda_);
+
+            if (validation_)
+            {
+                // the twin follows our taper schedule so both runs stay comparable
+                validation_->lambda_ = lambda_;
+                validation_->optimizer_->setLambda((fp) lambda_);
+            }
         }
     }
     else
@@ -230,6 +468,32 @@ bool Seamass::step()
 }
 
 
+void Seamass::validate() const
+{
+    li size = 0;
+    for (ii k = 0; k < ii(b_.size()); k++)
+        size += b_[k].size();
+
+    vector<fp> binCounts(size);
+    getOutputBinCounts(binCounts);
+    vector<fp> binCountsValidation(size);
+    validation_->getOutputBinCounts(binCountsValidation);
+
+    double sumSqrDiffs = 0.0;
+    double sumSqrs = 0.0;
+    for (li i = 0; i < size; i++)
+    {
+        sumSqrDiffs += double(binCounts[i] - binCountsValidation[i]) * double(binCounts[i] - binCountsValidation[i]);
+        sumSqrs += double(binCountsValidation[i]) * double(binCountsValidation[i]);
+    }
+
+    ostringstream oss;
+    oss << "Precision validation: " << iteration_ << " iterations, relative L2 difference of restored bin counts to fp32 = ";
+    oss << scientific << setprecision(3) << (sumSqrs > 0.0 ? sqrt(sumSqrDiffs / sumSqrs) : 0.0);
+    cout << oss.str() << endl;
+}
+
+
 ii Seamass::getIteration() const
 {
     return iteration_;
@@ -26,6 +26,7 @@
 
 #include "../asrl/Basis.hpp"
 #include "../asrl/OptimizerSrl.hpp"
+#include "../asrl/OptimizerAcceleration.hpp"
 
 
 /**
@@ -73,7 +74,10 @@ public:
         std::vector<ii> extent;
     };
 
-    Seamass(const Input& input, const std::vector<char>& scale, fp lambda, bool taperShrinkage, fp tolerance);
+    Seamass(const Input& input, const std::vector<char>& scale, fp lambda, bool taperShrinkage, fp tolerance,
+            MatrixSparse::Precision precision = MatrixSparse::Precision::Single, bool validatePrecision = false,
+            bool matrixFree = false, OptimizerAcceleration::Type acceleration = OptimizerAcceleration::Type::Eve1,
+            bool preserveAcceleration = false, char cascade = 0);
     Seamass(const Input& input, const Output& seed);
     virtual ~Seamass();
 
@@ -93,7 +97,10 @@ public:
     void getOutputControlPoints(ControlPoints& controlPoints) const;
 
 private:
-    void init(const Input& input, const std::vector<char>& scales, bool seed);
+    void init(const Input& input, const std::vector<char>& scales, bool seed, MatrixSparse::Precision precision, bool matrixFree,
+              OptimizerAcceleration::Type acceleration, bool preserveAcceleration);
+    void validate() const; // report difference between this reduced precision fit and its full precision twin
+    void warmStart(const Seamass& coarse); // replace our seed with the solution of a fit one scale coarser
 
     char dimensions_;
     std::vector<Basis*> bases_;
@@ -107,6 +114,8 @@ private:
     bool taperShrinkage_;
     fp tolerance_;
     int iteration_;
+
+    Seamass* validation_; // full precision twin stepped in lockstep when validating reduced precision storage
 };
 
 
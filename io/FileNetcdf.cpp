@@ -21,6 +21,7 @@
 
 
 #include "FileNetcdf.hpp"
+#include <kernel.hpp>
 #include <cstring>
 
 
@@ -256,28 +257,33 @@ void FileNetcdf::read(MatrixSparse& a, const string name, int grpid)
 {
     int grpidMat = open_Group(name, grpid);
 
-    vector<ii> m(1);
-    read_AttNC("m", NC_GLOBAL, m, grpidMat);
+    // indices may have been written by either a 32 or 64 bit addressing build
+    long long m;
+    if (( retval_ = nc_get_att_longlong(grpidMat, NC_GLOBAL, "m", &m) ))
+        err(retval_);
+    kernel::checkIndex(m, name + " rows");
 
-    vector<ii> n(1);
-    read_AttNC("n", NC_GLOBAL, n, grpidMat);
+    long long n;
+    if (( retval_ = nc_get_att_longlong(grpidMat, NC_GLOBAL, "n", &n) ))
+        err(retval_);
+    kernel::checkIndex(n, name + " columns");
 
     if (read_VarIDNC("v", grpidMat) != -1)
     {
         vector<ii> rowind;
-        read_VecNC("i", rowind, grpidMat);
+        read_IndicesNC("i", rowind, grpidMat);
 
         vector<ii> colind;
-        read_VecNC("j", colind, grpidMat);
+        read_IndicesNC("j", colind, grpidMat);
 
         vector<fp> acoo;
         read_VecNC("v", acoo, grpidMat);
 
-        a.copy(m[0], n[0], acoo.size(), rowind.data(), colind.data(), acoo.data());
+        a.copy((ii)m, (ii)n, acoo.size(), rowind.data(), colind.data(), acoo.data());
     }
     else
     {
-        a.init(m[0], n[0]);
+        a.init((ii)m, (ii)n);
     }
 }
 
@@ -309,6 +315,43 @@ void FileNetcdf::write(const MatrixSparse& a, const string name, int grpid)
 }
 
 
+void FileNetcdf::read_IndicesNC(const string dataSet, vector<ii>& indices, int grpid)
+{
+    if(grpid == 0) grpid = ncid_;
+
+    int varid;
+    if((retval_ = nc_inq_varid(grpid, dataSet.c_str(), &varid) ))
+        err(retval_);
+
+    size_t len = read_DimNC(dataSet, grpid)[0];
+    kernel::checkIndex(len, dataSet);
+    indices.resize(len);
+
+    nc_type xtype;
+    if((retval_ = nc_inq_vartype(grpid, varid, &xtype) ))
+        err(retval_);
+
+    if (xtype == (sizeof(ii) == 4 ? NC_INT : NC_INT64))
+    {
+        if (( retval_ = nc_get_var(grpid, varid, indices.data()) ))
+            err(retval_);
+    }
+    else
+    {
+        // other width, so convert through 64 bit and check each index fits
+        vector<long long> buffer(len);
+        if (( retval_ = nc_get_var_longlong(grpid, varid, buffer.data()) ))
+            err(retval_);
+
+        for (size_t i = 0; i < len; i++)
+        {
+            kernel::checkIndex(buffer[i], dataSet);
+            indices[i] = (ii)buffer[i];
+        }
+    }
+}
+
+
 void FileNetcdf::err(int e)
 {
     throw runtime_error("ERROR: '" + string(nc_strerror(e)) + "' processing " + fileName_);
@@ -160,6 +160,7 @@ private:
     int ncid_;
     int retval_;
     vector<InfoGrpVar> dataSetList_;
+    void read_IndicesNC(const string dataSet, vector<ii>& indices, int grpid); // 32 or 64 bit indices as ii
     void err(int e);
 };
 
@@ -51,10 +51,13 @@ void ObserverMatrixSparse::notice(const std::string& message, const MatrixSparse
 
         file.write(*a, "a");
 
-        for (ii nz = 0; nz < a->nnz(); nz++)
+        if (a->getPrecision() == MatrixSparse::Precision::Single)
         {
-            if (a->vs()[nz] != a->vs()[nz])
-                throw runtime_error("EEK nan!");
+            for (ii nz = 0; nz < a->nnz(); nz++)
+            {
+                if (a->vs()[nz] != a->vs()[nz])
+                    throw runtime_error("EEK nan!");
+            }
         }
     }
 }
@@ -69,8 +69,7 @@ void Matrix::copy(ii m, ii n, const fp *vs)
 {
     init(m, n);
 
-    for (ii i = 0; i < m_; i++)
-        ippsCopy_32f(&vs[i * n_], vs_, n_);
+    copyValues(vs, vs_, (li)m_ * n_);
 }
 
 
@@ -89,7 +88,7 @@ fp Matrix::sum() const
     for (ii i = 0; i < m_; i++)
     {
         fp sumRow;
-        ippsSum_32f(&vs_[i * n_], n_, &sumRow, ippAlgHintFast);
+        ippsSum_32f(&vs_[(li)i * n_], n_, &sumRow, ippAlgHintFast);
         sum += sumRow;
     }
 
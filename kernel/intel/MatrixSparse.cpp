@@ -28,6 +28,7 @@
 #include <cassert>
 #include <cstring>
 #include <algorithm>
+#include <limits>
 #include <ippcore.h>
 #include <ipps.h>
 #if defined(_OPENMP)
@@ -37,11 +38,79 @@ using namespace std;
 using namespace kernel;
 
 
-MatrixSparse::MatrixSparse(ii m, ii n) : m_(m), n_(n), is1_(0), isOwned_(false), isSorted_(true)
+MatrixSparse::MatrixSparse(ii m, ii n) : m_(m), n_(n), is1_(0), precision_(Precision::Single), hs_(0), isDense_(false), mat_(0), isOwned_(false), isSorted_(true)
 {
 }
 
 
+static const ii VALUE_CHUNK = 4096; // values converted at a time from 16 bit storage, small enough to stay in L1
+static const ii SMALL_NNZ = 1024; // operations with no more non-zeros than this skip MKL, whose per call overheads dominate
+static const ii BAND_TILE = 1024; // columns of a dense matmulBand output row built at a time, so the band of rows stays in L1
+
+
+// 16 bit storage conversions, bfloat16 is the top half of an IEEE float (fp must be float)
+static void fromPrecision(MatrixSparse::Precision precision, const unsigned short* hs, fp* vs, ii length)
+{
+    if (precision == MatrixSparse::Precision::Half)
+    {
+        ippsConvert_16f32f(reinterpret_cast<const Ipp16f*>(hs), vs, length);
+    }
+    else
+    {
+        unsigned int* us = reinterpret_cast<unsigned int*>(vs);
+        #pragma omp simd
+        for (ii i = 0; i < length; i++)
+            us[i] = (unsigned int)hs[i] << 16;
+    }
+}
+
+
+static void toPrecision(MatrixSparse::Precision precision, const fp* vs, unsigned short* hs, ii length)
+{
+    if (precision == MatrixSparse::Precision::Half)
+    {
+        ippsConvert_32f16f(vs, reinterpret_cast<Ipp16f*>(hs), length, ippRndNear);
+    }
+    else
+    {
+        const unsigned int* us = reinterpret_cast<const unsigned int*>(vs);
+        #pragma omp simd
+        for (ii i = 0; i < length; i++)
+            hs[i] = (unsigned short)((us[i] + 0x7fff + ((us[i] >> 16) & 1)) >> 16); // round to nearest even
+    }
+}
+
+
+template<typename Function>
+void MatrixSparse::forValues(Function f) const
+{
+    if (!is1_)
+        return;
+
+    if (precision_ == Precision::Single)
+    {
+        f(li(0), is1_[m_ - 1], vs_);
+    }
+    else
+    {
+        li nnz = is1_[m_ - 1];
+
+        #pragma omp parallel
+        {
+            fp vs[VALUE_CHUNK];
+
+            #pragma omp for
+            for (li offset = 0; offset < nnz; offset += VALUE_CHUNK)
+            {
+                ii length = ii(min(nnz - offset, li(VALUE_CHUNK)));
+                fromPrecision(precision_, &hs_[offset], vs, length);
+                f(offset, length, vs);
+            }
+        }
+    }
+}
+
+
 MatrixSparse::~MatrixSparse()
 {
     free();
@@ -61,18 +130,217 @@ void MatrixSparse::free()
 {
     if (is1_)
     {
-        status_ = mkl_sparse_destroy(mat_);
-        assert(!status_);
+        if (mat_)
+        {
+            status_ = mkl_sparse_destroy(mat_);
+            assert(!status_);
+        }
 
         if (isOwned_)
         {
             mkl_free(is0_);
-            mkl_free(js_);
-            mkl_free(vs_);
+            if (!isDense_)
+                mkl_free(js_);
+            if (precision_ == Precision::Single)
+                mkl_free(vs_);
+            else
+                mkl_free(hs_);
         }
 
         is1_ = 0;
     }
+
+    mat_ = 0;
+    precision_ = Precision::Single;
+    isDense_ = false;
+}
+
+
+void MatrixSparse::initDense(ii m, ii n)
+{
+    init(m, n);
+    checkIndex((li)m * n, "dense");
+
+    if (m > 0 && n > 0)
+    {
+        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+        is1_ = is0_ + 1;
+        for (ii i = 0; i <= m; i++)
+            is0_[i] = i * n;
+        js_ = 0;
+        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m - 1], 64));
+
+        isDense_ = true;
+        isOwned_ = true;
+        isSorted_ = true;
+    }
+}
+
+
+inline ii MatrixSparse::column(ii i, ii nz) const
+{
+    return isDense_ ? nz - is0_[i] : js_[nz];
+}
+
+
+void MatrixSparse::copySmall(ii m, ii n, ii length, const ii* rowind, const ii* colind, const fp* acoo)
+{
+    assert(length <= SMALL_NNZ);
+
+    init(m, n);
+
+    if (m > 0 && length > 0)
+    {
+        ii js[SMALL_NNZ];
+        fp vs[SMALL_NNZ];
+
+        // bucket by row, using the row pointers as cursors
+        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+        is1_ = is0_ + 1;
+        for (ii i = 0; i <= m; i++)
+            is0_[i] = 0;
+        for (ii nz = 0; nz < length; nz++)
+            is0_[rowind[nz] + 1]++;
+        for (ii i = 0; i < m; i++)
+            is1_[i] += is0_[i];
+        for (ii nz = 0; nz < length; nz++)
+        {
+            ii pos = is0_[rowind[nz]]++;
+            js[pos] = colind[nz];
+            vs[pos] = acoo[nz];
+        }
+        for (ii i = m; i > 0; i--)
+            is0_[i] = is0_[i - 1];
+        is0_[0] = 0;
+
+        // insertion sort each (short) row and sum duplicates, compacting as we go
+        ii nnz = 0;
+        ii start = 0;
+        for (ii i = 0; i < m; i++)
+        {
+            ii end = is1_[i];
+
+            for (ii nz = start + 1; nz < end; nz++)
+            {
+                ii j = js[nz];
+                fp v = vs[nz];
+                ii k = nz;
+                for (; k > start && js[k - 1] > j; k--)
+                {
+                    js[k] = js[k - 1];
+                    vs[k] = vs[k - 1];
+                }
+                js[k] = j;
+                vs[k] = v;
+            }
+
+            ii rowStart = nnz;
+            for (ii nz = start; nz < end; nz++)
+            {
+                if (nnz > rowStart && js[nnz - 1] == js[nz])
+                {
+                    vs[nnz - 1] += vs[nz];
+                }
+                else
+                {
+                    js[nnz] = js[nz];
+                    vs[nnz] = vs[nz];
+                    nnz++;
+                }
+            }
+
+            start = end;
+            is1_[i] = nnz;
+        }
+
+        js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * nnz, 64));
+        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * nnz, 64));
+        memcpy(js_, js, sizeof(ii) * nnz);
+        memcpy(vs_, vs, sizeof(fp) * nnz);
+
+        // no MKL handle, as small matrices are mostly used by the in-house loops; handle() creates one if needed
+        isOwned_ = true;
+        isSorted_ = true;
+    }
+}
+
+
+bool MatrixSparse::addContained(const ii* is0, const ii* is1, const ii* js, const fp* vs)
+{
+    assert(!isDense_ && precision_ == Precision::Single);
+
+    sort();
+
+    // check every non-zero has somewhere to go first, so a failure leaves us untouched
+    bool contained = true;
+    #pragma omp parallel for reduction(&&:contained)
+    for (ii i = 0; i < m_; i++)
+    {
+        for (ii nz = is0[i]; nz < is1[i]; nz++)
+        {
+            if (!binary_search(&js_[is0_[i]], &js_[is1_[i]], js[nz]))
+            {
+                contained = false;
+                break;
+            }
+        }
+    }
+
+    if (contained)
+    {
+        #pragma omp parallel for
+        for (ii i = 0; i < m_; i++)
+        {
+            for (ii nz = is0[i]; nz < is1[i]; nz++)
+                vs_[lower_bound(&js_[is0_[i]], &js_[is1_[i]], js[nz]) - js_] += vs[nz];
+        }
+    }
+
+    return contained;
+}
+
+
+sparse_matrix_t MatrixSparse::handle() const
+{
+    assert(is1_ && !isDense_ && precision_ == Precision::Single);
+
+    // views and small matrices only create their MKL handle when an MKL routine first needs one
+    if (!mat_)
+    {
+        sparse_matrix_t& _mat_ = const_cast<sparse_matrix_t&>(mat_);
+        sparse_status_t status = mkl_sparse_s_create_csr(&_mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
+        assert(!status);
+    }
+
+    return mat_;
+}
+
+
+bool MatrixSparse::isSamePattern(const MatrixSparse& a) const
+{
+    if (m_ != a.m_ || n_ != a.n_ || nnz() != a.nnz())
+        return false;
+
+    if (is1_ && !(isDense_ && a.isDense_))
+    {
+        // a full sparse matrix that is sorted has the same pattern as a dense one
+        if (isDense_ || a.isDense_)
+            return nnz() == size() && isSorted_ && a.isSorted_;
+
+        for (ii i = 0; i < m_; i++)
+        {
+            if (is0_[i] != a.is0_[i])
+                return false;
+        }
+
+        for (ii nz = 0; nz < is1_[m_ - 1]; nz++)
+        {
+            if (js_[nz] != a.js_[nz])
+                return false;
+        }
+    }
+
+    return true;
 }
 
 
@@ -117,10 +385,21 @@ ii MatrixSparse::nnzActual() const
 {
     ii count = 0;
 
-    for (ii nz = 0; nz < nnz(); nz++)
+    if (precision_ == Precision::Single)
+    {
+        for (ii nz = 0; nz < nnz(); nz++)
+        {
+            if (vs_[nz] != 0.0)
+                count++;
+        }
+    }
+    else
     {
-        if (vs_[nz] != 0.0)
-            count++;
+        for (ii nz = 0; nz < nnz(); nz++)
+        {
+            if (hs_[nz] & 0x7fff) // both 16 bit formats have the sign in the top bit
+                count++;
+        }
     }
 
     return count;
@@ -133,56 +412,63 @@ fp* MatrixSparse::vs() const
 }
 
 
-// SEEMS OPTIMAL
-void MatrixSparse::copy(const MatrixSparse& a, bool transpose)
+bool MatrixSparse::isDense() const
+{
+    return isDense_;
+}
+
+
+void MatrixSparse::prepareConcurrentReads() const
+{
+    if (is1_ && !isDense_ && precision_ == Precision::Single)
+    {
+        sort();
+        handle();
+    }
+}
+
+
+void MatrixSparse::setDense(bool dense)
 {
     if (getDebugLevel() % 10 >= 4)
     {
         ostringstream oss;
-        oss << getTimeStamp() << "       " << (transpose ? "t(" : "") << "A" << a << (transpose ? ")" : "") << " := ...";
+        oss << getTimeStamp() << "       X" << *this << (dense ? " as dense" : " as sparse") << " := ...";
         info(oss.str());
     }
 
-    if (transpose)
-        init(a.n_, a.m_);
-    else
-        init(a.m_, a.n_);
+    assert(precision_ == Precision::Single);
 
-    if (a.is1_)
+    if (is1_ && dense != isDense_)
     {
-        if (transpose)
+        if (dense)
         {
-            if (a.is1_)
-            {
-                mkl_sparse_convert_csr(a.mat_, SPARSE_OPERATION_TRANSPOSE, &mat_);
+            assert(nnz() == size());
+            sort();
 
-                sparse_index_base_t indexing;
-                status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
-                assert(!status_);
-
-                isOwned_ = false;
-                isSorted_ = true;
-            }
+            MatrixSparse t;
+            t.initDense(m_, n_);
+            copyValues(vs_, t.vs_, t.nnz());
+            swap(t);
         }
         else
         {
-            if (a.is1_)
-            {
-                is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (a.m_ + 1), 64));
-                is1_ = is0_ + 1;
-                js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * a.is1_[m_ - 1], 64));
-                vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * a.is1_[m_ - 1], 64));
+            MatrixSparse t;
+            t.copy(*this);
+            t.isDense_ = false;
 
-                ippsCopy_32s(a.is0_, is0_, a.m_ + 1);
-                ippsCopy_32s(a.js_, js_, a.is1_[m_ - 1]);
-                ippsCopy_32f(a.vs_, vs_, a.is1_[m_ - 1]);
+            t.js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * t.nnz(), 64));
+            #pragma omp parallel for
+            for (ii i = 0; i < m_; i++)
+            {
+                for (ii j = 0; j < n_; j++)
+                    t.js_[t.is0_[i] + j] = j;
+            }
 
-                status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
-                assert(!status_);
+            t.status_ = mkl_sparse_s_create_csr(&t.mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, t.is0_, t.is1_, t.js_, t.vs_);
+            assert(!t.status_);
 
-                isOwned_ = true;
-                isSorted_ = a.isSorted_;
-            }
+            swap(t);
         }
     }
 
@@ -190,102 +476,299 @@ void MatrixSparse::copy(const MatrixSparse& a, bool transpose)
     {
         ostringstream oss;
         oss << getTimeStamp() << "       ... X" << *this;
-        info(oss.str(), this);
+        info(oss.str());
     }
 }
 
 
-// SEEMS OPTIMAL
-void MatrixSparse::copy(ii m, ii n, ii length, const ii* rowind, const ii* colind, const fp* acoo)
+MatrixSparse::Precision MatrixSparse::getPrecision() const
+{
+    return precision_;
+}
+
+
+void MatrixSparse::setPrecision(Precision precision)
 {
     if (getDebugLevel() % 10 >= 4)
     {
         ostringstream oss;
-        oss << getTimeStamp() << "       copy(COO) := ...";
+        oss << getTimeStamp() << "       X" << *this << " as " << (precision == Precision::Single ? "fp32" : (precision == Precision::Half ? "fp16" : "bf16")) << " := ...";
         info(oss.str());
     }
 
-    init(m, n);
-
-    if (length > 0)
+    if (is1_ && precision != precision_)
     {
-        fp* c_acoo = const_cast<fp*>(acoo);
-        ii* c_rowind = const_cast<ii*>(rowind);
-        ii* c_colind = const_cast<ii*>(colind);
+        sort();
+        ii nnz = is1_[m_ - 1];
 
-        sparse_matrix_t t;
-        status_ = mkl_sparse_s_create_coo(&t, SPARSE_INDEX_BASE_ZERO, m_, n_, length, c_rowind, c_colind, c_acoo);
-        assert(!status_);
+        // the indices must be ours as an MKL handle cannot hold 16 bit values
+        ii* is0 = is0_;
+        ii* js = js_;
+        if (!isOwned_)
+        {
+            is0 = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
+            copyIndices(is0_, is0, m_ + 1);
+            if (!isDense_)
+            {
+                js = static_cast<ii*>(mkl_malloc(sizeof(ii) * nnz, 64));
+                copyIndices(js_, js, nnz);
+            }
+        }
 
-        status_ = mkl_sparse_convert_csr(t, SPARSE_OPERATION_NON_TRANSPOSE, &mat_);
-        assert(!status_);
+        if (precision_ == Precision::Single)
+        {
+            hs_ = static_cast<unsigned short*>(mkl_malloc(sizeof(unsigned short) * nnz, 64));
 
-        status_ = mkl_sparse_destroy(t);
-        assert(!status_);
+            #pragma omp parallel for
+            for (li offset = 0; offset < nnz; offset += VALUE_CHUNK)
+                toPrecision(precision, &vs_[offset], &hs_[offset], ii(min(nnz - offset, li(VALUE_CHUNK))));
 
-        sparse_index_base_t indexing;
-        status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
-        assert(!status_);
+            if (mat_)
+            {
+                status_ = mkl_sparse_destroy(mat_);
+                assert(!status_);
+                mat_ = 0;
+            }
+            if (isOwned_)
+                mkl_free(vs_);
+            vs_ = 0;
+        }
+        else if (precision == Precision::Single)
+        {
+            vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * nnz, 64));
+            forValues([&](li offset, ii length, const fp* vs)
+            {
+                memcpy(&vs_[offset], vs, sizeof(fp) * length);
+            });
+            mkl_free(hs_);
+            hs_ = 0;
 
-        isOwned_ = false;
-        isSorted_ = true;
+            if (!isDense_)
+            {
+                status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0, is0 + 1, js, vs_);
+                assert(!status_);
+            }
+        }
+        else
+        {
+            forValues([&](li offset, ii length, const fp* vs)
+            {
+                toPrecision(precision, vs, &hs_[offset], length);
+            });
+        }
+
+        is0_ = is0;
+        is1_ = is0 + 1;
+        js_ = js;
+        isOwned_ = true;
     }
 
+    precision_ = precision;
+
     if (getDebugLevel() % 10 >= 4)
     {
         ostringstream oss;
         oss << getTimeStamp() << "       ... X" << *this;
-        info(oss.str(), this);
-    }        
+        info(oss.str());
+    }
 }
 
 
-// todo: optimize
-void MatrixSparse::copy(const Matrix &a)
+// SEEMS OPTIMAL
+void MatrixSparse::copy(const MatrixSparse& a, bool transpose)
 {
-    free();
-
-    vector<ii> rowind;
-    vector<ii> colind;
-    vector<fp> acoo;
-
-    for (ii i = 0; i < a.m(); i++)
+    if (getDebugLevel() % 10 >= 4)
     {
-        for (ii j = 0; j < a.n(); j++)
-        {
-            if (a.vs()[j + i * a.n()] != 0.0)
-            {
-                rowind.push_back(i);
-                colind.push_back(j);
-                acoo.push_back(a.vs()[j + i * a.n()]);
-            }
-        }
-    }
-
-    copy(a.m(), a.n(), acoo.size(), rowind.data(), colind.data(), acoo.data());
-}
+        ostringstream oss;
+        oss << getTimeStamp() << "       " << (transpose ? "t(" : "") << "A" << a << (transpose ? ")" : "") << " := ...";
+        info(oss.str());
+    }
 
+    if (transpose)
+        init(a.n_, a.m_);
+    else
+        init(a.m_, a.n_);
 
-// todo: optimize
-void MatrixSparse::copy(ii m, ii n, fp v)
-{
-    free();
+    assert(!transpose || a.precision_ == Precision::Single);
 
-    vector<ii> rowind;
-    vector<ii> colind;
-    vector<fp> acoo;
+    if (a.is1_ && a.isDense_)
+    {
+        initDense(m_, n_);
 
-    for (ii i = 0; i < m; i++)
+        if (transpose)
+        {
+            #pragma omp parallel for
+            for (ii i = 0; i < m_; i++)
+            {
+                for (ii j = 0; j < n_; j++)
+                    vs_[is0_[i] + j] = a.vs_[a.is0_[j] + i];
+            }
+        }
+        else
+        {
+            a.forValues([&](li offset, ii length, const fp* vs)
+            {
+                copyValues(vs, &vs_[offset], length);
+            });
+        }
+    }
+    else if (a.is1_)
     {
-        for (ii j = 0; j < n; j++)
+        if (transpose && a.nnz() <= SMALL_NNZ)
+        {
+            ii is[SMALL_NNZ];
+            for (ii i = 0; i < a.m_; i++)
+            {
+                for (ii nz = a.is0_[i]; nz < a.is1_[i]; nz++)
+                    is[nz] = i;
+            }
+
+            copySmall(a.n_, a.m_, a.nnz(), a.js_, is, a.vs_);
+        }
+        else if (transpose)
+        {
+            if (a.is1_)
+            {
+                mkl_sparse_convert_csr(a.handle(), SPARSE_OPERATION_TRANSPOSE, &mat_);
+
+                sparse_index_base_t indexing;
+                status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
+                assert(!status_);
+
+                isOwned_ = false;
+                isSorted_ = true;
+            }
+        }
+        else
         {
-            rowind.push_back(i);
-            colind.push_back(j);
-            acoo.push_back(v);
+            if (a.is1_)
+            {
+                is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (a.m_ + 1), 64));
+                is1_ = is0_ + 1;
+                js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * a.is1_[m_ - 1], 64));
+                vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * a.is1_[m_ - 1], 64));
+
+                copyIndices(a.is0_, is0_, a.m_ + 1);
+                copyIndices(a.js_, js_, a.is1_[m_ - 1]);
+                a.forValues([&](li offset, ii length, const fp* vs)
+                {
+                    copyValues(vs, &vs_[offset], length);
+                });
+
+                status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
+                assert(!status_);
+
+                isOwned_ = true;
+                isSorted_ = a.isSorted_;
+            }
         }
     }
 
-    copy(m, n, acoo.size(), rowind.data(), colind.data(), acoo.data());
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str(), this);
+    }
+}
+
+
+// SEEMS OPTIMAL
+void MatrixSparse::copy(ii m, ii n, ii length, const ii* rowind, const ii* colind, const fp* acoo)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       copy(COO) := ...";
+        info(oss.str());
+    }
+
+    init(m, n);
+
+    if (length > 0 && length <= SMALL_NNZ)
+    {
+        copySmall(m, n, length, rowind, colind, acoo);
+    }
+    else if (length > 0)
+    {
+        fp* c_acoo = const_cast<fp*>(acoo);
+        ii* c_rowind = const_cast<ii*>(rowind);
+        ii* c_colind = const_cast<ii*>(colind);
+
+        sparse_matrix_t t;
+        status_ = mkl_sparse_s_create_coo(&t, SPARSE_INDEX_BASE_ZERO, m_, n_, length, c_rowind, c_colind, c_acoo);
+        assert(!status_);
+
+        status_ = mkl_sparse_convert_csr(t, SPARSE_OPERATION_NON_TRANSPOSE, &mat_);
+        assert(!status_);
+
+        status_ = mkl_sparse_destroy(t);
+        assert(!status_);
+
+        sparse_index_base_t indexing;
+        status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
+        assert(!status_);
+
+        isOwned_ = false;
+        isSorted_ = true;
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str(), this);
+    }        
+}
+
+
+void MatrixSparse::copy(const Matrix &a)
+{
+    const fp* vs = a.vs();
+    ii n = a.n();
+
+    copyRows(a.m(), n,
+        [vs, n](ii i)
+        {
+            ii nnz = 0;
+            for (ii j = 0; j < n; j++)
+            {
+                if (vs[j + i * n] != 0.0)
+                    nnz++;
+            }
+            return nnz;
+        },
+        [vs, n](ii i, ii* js, fp* rowVs)
+        {
+            ii nz = 0;
+            for (ii j = 0; j < n; j++)
+            {
+                if (vs[j + i * n] != 0.0)
+                {
+                    js[nz] = j;
+                    rowVs[nz] = vs[j + i * n];
+                    nz++;
+                }
+            }
+        });
+}
+
+
+void MatrixSparse::copy(ii m, ii n, fp v)
+{
+    copyRows(m, n,
+        [n](ii i)
+        {
+            return n;
+        },
+        [n, v](ii i, ii* js, fp* vs)
+        {
+            for (ii j = 0; j < n; j++)
+            {
+                js[j] = j;
+                vs[j] = v;
+            }
+        });
 }
 
 
@@ -308,9 +791,10 @@ void MatrixSparse::copyConcatenate(const std::vector<MatrixSparse> &as)
 
         init((ii)as.size(), as[0].n());
 
-        ii nnz = 0;
+        li nnz = 0;
         for (ii i = 0; i < m_; i++)
             nnz += as[i].nnz();
+        checkIndex(nnz, "copyConcatenate");
 
         if (nnz > 0)
         {
@@ -327,8 +811,16 @@ void MatrixSparse::copyConcatenate(const std::vector<MatrixSparse> &as)
             {
                 if (as[i].is1_)
                 {
-                    ippsCopy_32s(as[i].js_, &js_[is0_[i]], as[i].is1_[0]);
-                    ippsCopy_32f(as[i].vs_, &vs_[is0_[i]], as[i].is1_[0]);
+                    if (as[i].isDense_)
+                    {
+                        for (ii nz = 0; nz < as[i].is1_[0]; nz++)
+                            js_[is0_[i] + nz] = nz;
+                    }
+                    else
+                    {
+                        copyIndices(as[i].js_, &js_[is0_[i]], as[i].is1_[0]);
+                    }
+                    copyValues(as[i].vs_, &vs_[is0_[i]], as[i].is1_[0]);
                 }
             }
 
@@ -359,46 +851,45 @@ void MatrixSparse::copyConcatenate(const std::vector<MatrixSparse> &as)
 
 // SEEMS OPTIMAL
 void MatrixSparse::copySubset(const MatrixSparse &a)
+{
+    copySubset(a, vector<char>());
+}
+
+
+void MatrixSparse::copySubset(const MatrixSparse &a, const vector<char>& rows)
 {
     if (getDebugLevel() % 10 >= 4)
     {
         ostringstream oss;
-        oss << getTimeStamp() << "       copySubset(A" << a << ") within X" << *this << " := ...";
+        oss << getTimeStamp() << "       copySubset(A" << a << ") within X" << *this;
+        if (rows.size()) oss << " rows " << m_ - ii(count(rows.begin(), rows.end(), 0)) << "/" << m_;
+        oss << " := ...";
         info(oss.str());
     }
 
     assert(m_ == a.m_);
     assert(n_ == a.n_);
+    assert(rows.size() == 0 || ii(rows.size()) == m_);
 
     if (is1_ && a.is1_)
     {
         sort();
         a.sort();
 
-        //ii count = 0;
-        //#pragma omp parallel
         for (ii i = 0; i < m_; i++)
         {
+            if (rows.size() && !rows[i])
+                continue;
+
             ii a_nz = a.is0_[i];
             for (ii nz = is0_[i]; nz < is1_[i]; nz++)
             {
-                //bool found = false;
-                for (; a_nz < a.is1_[i]; a_nz++)
-                {
-                    if (js_[nz] == a.js_[a_nz])
-                    {
-                        vs_[nz] = a.vs_[a_nz];
-                        //found = true;
-                        break;
-                    }
-                }
-
-                //if (!found)
-                //    count++;
+                // elements missing from a are left as they are
+                for (; a_nz < a.is1_[i] && a.column(i, a_nz) < column(i, nz); a_nz++);
+                if (a_nz < a.is1_[i] && a.column(i, a_nz) == column(i, nz))
+                    vs_[nz] = a.vs_[a_nz];
              }
         }
-        //if (count > 0) oss << count << " missing.";
-        //if (count > 0) exit(0);
 
         isSorted_ = true;
     }
@@ -412,6 +903,29 @@ void MatrixSparse::copySubset(const MatrixSparse &a)
 }
 
 
+void MatrixSparse::copyRows(const MatrixSparse &a, const vector<char>& rows)
+{
+    assert(ii(rows.size()) == a.m_);
+    assert(a.precision_ == Precision::Single);
+
+    copyRows(a.m_, a.n_, [&](ii i)
+    {
+        return a.is1_ && rows[i] ? a.is1_[i] - a.is0_[i] : 0;
+    },
+    [&](ii i, ii* js, fp* vs)
+    {
+        if (rows[i])
+        {
+            for (ii nz = a.is0_[i]; nz < a.is1_[i]; nz++)
+            {
+                *js++ = a.column(i, nz);
+                *vs++ = a.vs_[nz];
+            }
+        }
+    }, a.isSorted_);
+}
+
+
 // SEEMS OPTIMAL
 void MatrixSparse::copySubset(const MatrixSparse &a, const MatrixSparse &b)
 {
@@ -432,41 +946,63 @@ void MatrixSparse::copySubset(const MatrixSparse &a, const MatrixSparse &b)
         a.sort();
         b.sort();
 
-        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
-        ippsCopy_32s(b.is0_, is0_, m_ + 1);
-        is1_ = is0_ + 1;
-        js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
-        ippsCopy_32s(b.js_, js_, is1_[m_ - 1]);
-        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+        if (b.isDense_)
+        {
+            initDense(m_, n_);
+        }
+        else
+        {
+            is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
+            copyIndices(b.is0_, is0_, m_ + 1);
+            is1_ = is0_ + 1;
+            js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
+            copyIndices(b.js_, js_, is1_[m_ - 1]);
+        }
 
-        //ii count = 0;
-        //#pragma omp parallel
-        for (ii i = 0; i < m_; i++)
+        if (a.precision_ == Precision::Single)
         {
-            ii a_nz = a.is0_[i];
-            for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+            if (!isDense_)
+                vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+
+            for (ii i = 0; i < m_; i++)
             {
-                //bool found = false;
-                for (; a_nz < a.is1_[i]; a_nz++)
+                ii a_nz = a.is0_[i];
+                for (ii nz = is0_[i]; nz < is1_[i]; nz++)
                 {
-                    if (b.js_[nz] == a.js_[a_nz])
-                    {
-                        vs_[nz] = a.vs_[a_nz];
-                        //found = true;
-                        break;
-                    }
+                    // elements missing from a are zero
+                    for (; a_nz < a.is1_[i] && a.column(i, a_nz) < b.column(i, nz); a_nz++);
+                    vs_[nz] = a_nz < a.is1_[i] && a.column(i, a_nz) == b.column(i, nz) ? a.vs_[a_nz] : fp(0.0);
                 }
+            }
 
-                //if (!found)
-                //    count++;
+            if (!isDense_)
+            {
+                status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
+                assert(!status_);
             }
         }
-        //if (count > 0) oss << count << " missing.";
-        //if (count > 0) exit(0);
+        else
+        {
+            // 16 bit values are moved as they are
+            if (isDense_)
+            {
+                mkl_free(vs_);
+                vs_ = 0;
+            }
+            hs_ = static_cast<unsigned short*>(mkl_malloc(sizeof(unsigned short) * is1_[m_ - 1], 64));
 
+            for (ii i = 0; i < m_; i++)
+            {
+                ii a_nz = a.is0_[i];
+                for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+                {
+                    for (; a_nz < a.is1_[i] && a.column(i, a_nz) < b.column(i, nz); a_nz++);
+                    hs_[nz] = a_nz < a.is1_[i] && a.column(i, a_nz) == b.column(i, nz) ? a.hs_[a_nz] : (unsigned short)0;
+                }
+            }
 
-        status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
-        assert(!status_);
+            precision_ = a.precision_;
+        }
 
         isOwned_ = true;
         isSorted_ = true;
@@ -508,7 +1044,14 @@ ii MatrixSparse::copyPrune(const MatrixSparse &a, fp threshold)
             nnzCells += nnzs[i];
         }
 
-        if (nnzCells > 0)
+        if (nnzCells > 0 && nnzCells == size())
+        {
+            // nothing pruned from a full matrix, so store it without column indices
+            a.sort();
+            initDense(a.m_, a.n_);
+            copyValues(a.vs_, vs_, nnzCells);
+        }
+        else if (nnzCells > 0)
         {
             is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (a.m_ + 1), 64));
             is0_[0] = 0;
@@ -526,7 +1069,7 @@ ii MatrixSparse::copyPrune(const MatrixSparse &a, fp threshold)
                 {
                     if (a.vs_[a_nz] > threshold)
                     {
-                        js_[nz] = a.js_[a_nz];
+                        js_[nz] = a.column(i, a_nz);
                         vs_[nz] = a.vs_[a_nz];
                         nz++;
                     }
@@ -564,18 +1107,58 @@ ii MatrixSparse::copyPruneRows(const MatrixSparse &a, const MatrixSparse &b, boo
         info(oss.str());
     }
 
-    assert(bRows ? a.m_ == b.m_ : a.m_ == b.n_);
+    assert(!a.isDense_);
 
     init(a.m_, a.n_);
 
+    vector<ii> lengths;
+    ii rowsPruned = a.pruneRowsLengths(b, bRows, threshold, lengths);
+    if (lengths.size())
+    {
+        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
+        is0_[0] = 0;
+        is1_ = is0_ + 1;
+        for (ii i = 0; i < m_; i++)
+            is1_[i] = is0_[i] + lengths[i];
+
+        js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
+        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+        //#pragma omp parallel
+        for (ii i = 0; i < m_; i++)
+        {
+            copyIndices(&a.js_[a.is0_[i]], &js_[is0_[i]], is1_[i] - is0_[i]);
+            copyValues(&a.vs_[a.is0_[i]], &vs_[is0_[i]], is1_[i] - is0_[i]);
+        }
+
+        status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
+        assert(!status_);
+
+        isOwned_ = true;
+        isSorted_ = a.isSorted_;
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this << " (" << rowsPruned << " rows pruned)";
+        info(oss.str(), this);
+    }
+
+    return rowsPruned;
+}
+
+
+ii MatrixSparse::pruneRowsLengths(const MatrixSparse &b, bool bRows, fp threshold, vector<ii>& lengths) const
+{
+    assert(bRows ? m_ == b.m_ : m_ == b.n_);
+
     ii rowsPruned = 0;
-    if (a.is1_ && b.is1_)
+    if (is1_ && b.is1_)
     {
         ii aNnzRows = 0;
         for (ii i = 0; i < m_; i++)
-            if (a.is1_[i] - a.is0_[i] > 0)
+            if (is1_[i] - is0_[i] > 0)
                 aNnzRows++;
-        //oss << "aNnzRows=" << aNnzRows;
 
         vector<ii> rowOrColNnzs(m_, 0);
         if (bRows)
@@ -583,6 +1166,10 @@ ii MatrixSparse::copyPruneRows(const MatrixSparse &a, const MatrixSparse &b, boo
             for (ii i = 0; i < m_; i++)
                 rowOrColNnzs[i] = b.is1_[i] - b.is0_[i];
         }
+        else if (b.isDense_)
+        {
+            rowOrColNnzs.assign(m_, b.m_);
+        }
         else
         {
             for (ii nz = 0; nz < b.nnz(); nz++)
@@ -593,37 +1180,133 @@ ii MatrixSparse::copyPruneRows(const MatrixSparse &a, const MatrixSparse &b, boo
         for (ii i = 0; i < m_; i++)
             if (rowOrColNnzs[i] > 0)
                 bNnzRowsOrCols++;
-        //oss << "bNnzRowsOrCols=" << bNnzRowsOrCols;
 
         if (bNnzRowsOrCols / (fp) aNnzRows < threshold)
         {
-            is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
-            is0_[0] = 0;
-            is1_ = is0_ + 1;
-            for (ii i = 0; i < m_; i++)
-                is1_[i] = is0_[i] + (rowOrColNnzs[i] > 0 ? a.is1_[i] - a.is0_[i] : 0);
-
-            js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
-            vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
-            //#pragma omp parallel
+            lengths.resize(m_ + 1);
             for (ii i = 0; i < m_; i++)
-            {
-                ippsCopy_32s(&a.js_[a.is0_[i]], &js_[is0_[i]], is1_[i] - is0_[i]);
-                ippsCopy_32f(&a.vs_[a.is0_[i]], &vs_[is0_[i]], is1_[i] - is0_[i]);
-            }
+                lengths[i] = rowOrColNnzs[i] > 0 ? is1_[i] - is0_[i] : 0;
 
-            status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
-            assert(!status_);
-
-            isOwned_ = true;
-            isSorted_ = a.isSorted_;
-
-            rowsPruned = aNnzRows- bNnzRowsOrCols;
+            rowsPruned = aNnzRows - bNnzRowsOrCols;
         }
     }
 
-    if (getDebugLevel() % 10 >= 4)
-    {
+    return rowsPruned;
+}
+
+
+ii MatrixSparse::prune(fp threshold)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       prune(X" << *this << " <= ";
+        oss.unsetf(ios::floatfield);
+        oss << setprecision(8) << threshold << ") := ...";
+        info(oss.str());
+    }
+
+    ii nnzCells = 0;
+    if (isDense_ && precision_ == Precision::Single)
+    {
+        #pragma omp parallel for reduction(+:nnzCells)
+        for (ii nz = 0; nz < nnz(); nz++)
+        {
+            if (vs_[nz] > threshold)
+                nnzCells++;
+        }
+    }
+
+    if (isDense_ && nnzCells == size())
+    {
+        // nothing to prune
+    }
+    else if (precision_ != Precision::Single)
+    {
+        // values are compared in fp, so prune at full precision and convert back, which is exact
+        Precision precision = precision_;
+        setPrecision(Precision::Single);
+        nnzCells = prune(threshold);
+        setPrecision(precision);
+    }
+    else if (isDense_ || !isOwned_)
+    {
+        // we can only compact CSR arrays that we own
+        MatrixSparse t;
+        nnzCells = t.copyPrune(*this, threshold);
+        swap(t);
+    }
+    else if (is1_)
+    {
+        // compact each row in place first
+        vector<ii> lengths(m_ + 1);
+        #pragma omp parallel for reduction(+:nnzCells)
+        for (ii i = 0; i < m_; i++)
+        {
+            ii nz = is0_[i];
+            for (ii a_nz = is0_[i]; a_nz < is1_[i]; a_nz++)
+            {
+                if (vs_[a_nz] > threshold)
+                {
+                    js_[nz] = js_[a_nz];
+                    vs_[nz] = vs_[a_nz];
+                    nz++;
+                }
+            }
+
+            lengths[i] = nz - is0_[i];
+            nnzCells += lengths[i];
+        }
+
+        if (nnzCells < nnz())
+            compact(lengths);
+
+        if (nnzCells > 0 && nnzCells == size())
+            setDense(true);
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str(), this);
+    }
+
+    return nnzCells;
+}
+
+
+ii MatrixSparse::pruneRows(const MatrixSparse &b, bool bRows, fp threshold)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       pruneRows(X" << *this << ",";
+        oss << (bRows ? "rows(" : "columns(") << b << ")) where ";
+        oss << (bRows ? "nRows" : "nColumns") << " to prune > " << fixed << setprecision(1) << threshold * 100.0 << "% := ...";
+        info(oss.str());
+    }
+
+    assert(!isDense_);
+
+    vector<ii> lengths;
+    ii rowsPruned = pruneRowsLengths(b, bRows, threshold, lengths);
+    if (lengths.size())
+    {
+        if (isOwned_ && precision_ == Precision::Single)
+        {
+            compact(lengths);
+        }
+        else
+        {
+            MatrixSparse t;
+            t.copyPruneRows(*this, b, bRows, threshold);
+            swap(t);
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
         ostringstream oss;
         oss << getTimeStamp() << "       ... X" << *this << " (" << rowsPruned << " rows pruned)";
         info(oss.str(), this);
@@ -633,6 +1316,226 @@ ii MatrixSparse::copyPruneRows(const MatrixSparse &a, const MatrixSparse &b, boo
 }
 
 
+ii MatrixSparse::pruneColumns(const MatrixSparse& aT)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       pruneColumns(X" << *this << ",rows(" << aT << ")) := ...";
+        info(oss.str());
+    }
+
+    assert(aT.m_ == n_ && aT.n_ == m_);
+    assert(!aT.isDense_);
+
+    ii nnzPruned = 0;
+    if (is1_ && !aT.is1_)
+    {
+        nnzPruned = nnz();
+        init(m_, n_);
+    }
+    else if (is1_ && (isDense_ || !isOwned_ || precision_ != Precision::Single))
+    {
+        // we can only compact single precision CSR arrays that we own
+        MatrixSparse t;
+        t.copy(aT, true);
+        nnzPruned = nnz() - t.nnz();
+        swap(t);
+    }
+    else if (is1_)
+    {
+        // compact each row in place first, keeping the columns in the same order
+        vector<ii> lengths(m_ + 1);
+        #pragma omp parallel for reduction(+:nnzPruned)
+        for (ii i = 0; i < m_; i++)
+        {
+            ii nz = is0_[i];
+            for (ii a_nz = is0_[i]; a_nz < is1_[i]; a_nz++)
+            {
+                if (aT.is1_[js_[a_nz]] - aT.is0_[js_[a_nz]] > 0)
+                {
+                    js_[nz] = js_[a_nz];
+                    vs_[nz] = vs_[a_nz];
+                    nz++;
+                }
+            }
+
+            lengths[i] = nz - is0_[i];
+            nnzPruned += is1_[i] - nz;
+        }
+
+        if (nnzPruned > 0)
+            compact(lengths);
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this << " (" << nnzPruned << " non-zeros pruned)";
+        info(oss.str(), this);
+    }
+
+    return nnzPruned;
+}
+
+
+ii MatrixSparse::pruneUpdate(fp threshold, const MatrixSparse& x, const vector<MatrixSparse*>& as, fp& sumSqrs, fp& sumSqrDiffs)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       pruneUpdate(X" << *this << " <= ";
+        oss.unsetf(ios::floatfield);
+        oss << setprecision(8) << threshold << ", X0" << x << ", " << as.size() << " attached) := ...";
+        info(oss.str());
+    }
+
+    assert(x.m_ == m_ && x.n_ == n_);
+    assert(x.precision_ == Precision::Single);
+
+    ii nnzCells = 0;
+    if (is1_ && !isDense_ && isOwned_ && precision_ == Precision::Single)
+    {
+        sort();
+        x.sort();
+        assert(isSamePattern(x));
+
+        // attached matrices with our exact pattern are compacted alongside us, any others are resubset afterwards
+        vector<bool> inPlace(as.size());
+        for (size_t a = 0; a < as.size(); a++)
+        {
+            assert(as[a]->m_ == m_ && as[a]->n_ == n_);
+
+            inPlace[a] = as[a]->is1_ && !as[a]->isDense_ && as[a]->isOwned_;
+            if (inPlace[a])
+            {
+                as[a]->sort();
+                inPlace[a] = isSamePattern(*as[a]);
+            }
+        }
+
+        // one pass over each row: accumulate the termination metrics then compact the survivors in place
+        vector<ii> lengths(m_ + 1);
+        double sumSqrsRows = 0.0;
+        double sumSqrDiffsRows = 0.0;
+        #pragma omp parallel for reduction(+:nnzCells,sumSqrsRows,sumSqrDiffsRows)
+        for (ii i = 0; i < m_; i++)
+        {
+            ii nz = is0_[i];
+            for (ii a_nz = is0_[i]; a_nz < is1_[i]; a_nz++)
+            {
+                double x0 = x.vs_[a_nz];
+                double diff = x0 - vs_[a_nz];
+                sumSqrsRows += x0 * x0;
+                sumSqrDiffsRows += diff * diff;
+
+                if (vs_[a_nz] > threshold)
+                {
+                    js_[nz] = js_[a_nz];
+                    vs_[nz] = vs_[a_nz];
+
+                    for (size_t a = 0; a < as.size(); a++)
+                    {
+                        if (inPlace[a])
+                        {
+                            as[a]->js_[nz] = as[a]->js_[a_nz];
+                            if (as[a]->precision_ == Precision::Single)
+                                as[a]->vs_[nz] = as[a]->vs_[a_nz];
+                            else
+                                as[a]->hs_[nz] = as[a]->hs_[a_nz];
+                        }
+                    }
+
+                    nz++;
+                }
+            }
+
+            lengths[i] = nz - is0_[i];
+            nnzCells += lengths[i];
+        }
+        sumSqrs += fp(sumSqrsRows);
+        sumSqrDiffs += fp(sumSqrDiffsRows);
+
+        if (nnzCells < nnz())
+        {
+            for (size_t a = 0; a < as.size(); a++)
+            {
+                if (inPlace[a])
+                {
+                    vector<ii> aLengths(lengths);
+                    as[a]->compact(aLengths);
+                }
+            }
+
+            compact(lengths);
+        }
+
+        if (nnzCells > 0 && nnzCells == size())
+        {
+            setDense(true);
+            inPlace.assign(as.size(), false);
+        }
+
+        for (size_t a = 0; a < as.size(); a++)
+        {
+            if (!inPlace[a])
+            {
+                MatrixSparse t;
+                t.copySubset(*as[a], *this);
+                as[a]->swap(t);
+            }
+        }
+    }
+    else
+    {
+        // dense, 16 bit or not ours to compact, so take the long way round
+        sumSqrs += x.sumSqrs();
+        if (is1_)
+            sumSqrDiffs += x.sumSqrDiffsNonzeros(*this);
+        nnzCells = prune(threshold);
+
+        for (size_t a = 0; a < as.size(); a++)
+        {
+            MatrixSparse t;
+            t.copySubset(*as[a], *this);
+            as[a]->swap(t);
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str(), this);
+    }
+
+    return nnzCells;
+}
+
+
+void MatrixSparse::compact(vector<ii>& lengths)
+{
+    assert(isOwned_ && !isDense_);
+
+    // the MKL handle is recreated by handle() when next needed
+    if (mat_)
+    {
+        status_ = mkl_sparse_destroy(mat_);
+        assert(!status_);
+        mat_ = 0;
+    }
+
+    ii newNnz;
+    if (precision_ == Precision::Single)
+        newNnz = compactRows(m_, is0_, js_, vs_, lengths.data());
+    else
+        newNnz = compactRows(m_, is0_, js_, hs_, lengths.data());
+
+    if (newNnz == 0)
+        init(m_, n_);
+}
+
+
 void MatrixSparse::exportTo(ii* rowind, ii* colind, fp* acoo) const
 {
     if (getDebugLevel() % 10 >= 4)
@@ -645,9 +1548,35 @@ void MatrixSparse::exportTo(ii* rowind, ii* colind, fp* acoo) const
     ii length = nnz();
     if (length > 0)
     {
-        ii job[] = { 0, 0, 0, 0 , length, 3 };
-        ii info;
-        mkl_scsrcoo(job, &m_, vs_, js_, is0_, &length, acoo, rowind, colind, &info);
+        vector<fp> vs;
+        if (precision_ != Precision::Single)
+        {
+            vs.resize(length);
+            forValues([&](li offset, ii length, const fp* vsChunk)
+            {
+                copyValues(vsChunk, &vs[offset], length);
+            });
+        }
+
+        if (isDense_)
+        {
+            #pragma omp parallel for
+            for (ii i = 0; i < m_; i++)
+            {
+                for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+                {
+                    rowind[nz] = i;
+                    colind[nz] = nz - is0_[i];
+                }
+            }
+            copyValues(vs.size() ? vs.data() : vs_, acoo, length);
+        }
+        else
+        {
+            ii job[] = { 0, 0, 0, 0 , length, 3 };
+            ii info;
+            mkl_scsrcoo(job, &m_, vs.size() ? vs.data() : vs_, js_, is0_, &length, acoo, rowind, colind, &info);
+        }
     }
 
     if (getDebugLevel() % 10 >= 4)
@@ -668,7 +1597,11 @@ void MatrixSparse::exportTo(fp *vs) const
         info(oss.str());
     }
 
-    if (nnz() > 0)
+    if (isDense_)
+    {
+        copyValues(vs_, vs, nnz());
+    }
+    else if (nnz() > 0)
     {
         ii job[] = { 1, 0, 0, 2, 0, 0 };
         ii info;
@@ -701,6 +1634,7 @@ void MatrixSparse::add(fp alpha, bool transposeA, const MatrixSparse& a, const M
 
     assert((transposeA ? a.n() : a.m()) == b.m());
     assert((transposeA ? a.m() : a.n()) == b.n());
+    assert(!a.isDense_ && !b.isDense_);
 
     if (!a.is1_ || !b.is1_)
     {
@@ -715,11 +1649,40 @@ void MatrixSparse::add(fp alpha, bool transposeA, const MatrixSparse& a, const M
         copy(a, transposeA);
         mul(alpha);
     }
+    else if (a.nnz() + b.nnz() <= SMALL_NNZ)
+    {
+        ii is[SMALL_NNZ];
+        ii js[SMALL_NNZ];
+        fp vs[SMALL_NNZ];
+
+        ii length = 0;
+        for (ii i = 0; i < a.m_; i++)
+        {
+            for (ii nz = a.is0_[i]; nz < a.is1_[i]; nz++, length++)
+            {
+                is[length] = transposeA ? a.js_[nz] : i;
+                js[length] = transposeA ? i : a.js_[nz];
+                vs[length] = alpha * a.vs_[nz];
+            }
+        }
+        for (ii i = 0; i < b.m_; i++)
+        {
+            for (ii nz = b.is0_[i]; nz < b.is1_[i]; nz++, length++)
+            {
+                is[length] = i;
+                js[length] = b.js_[nz];
+                vs[length] = b.vs_[nz];
+            }
+        }
+
+        copySmall(transposeA ? a.n() : a.m(), b.n(), length, is, js, vs);
+    }
     else
     {
         init(transposeA ? a.n() : a.m(), b.n());
+        checkIndex(min((li)a.nnz() + b.nnz(), (li)m_ * n_), "add");
 
-        status_ = mkl_sparse_s_add(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE, a.mat_, alpha, b.mat_, &mat_); assert(!status_);
+        status_ = mkl_sparse_s_add(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE, a.handle(), alpha, b.handle(), &mat_); assert(!status_);
         
         sparse_index_base_t indexing;
         status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
@@ -738,150 +1701,560 @@ void MatrixSparse::add(fp alpha, bool transposeA, const MatrixSparse& a, const M
 }
 
 
-void MatrixSparse::matmul(bool transposeA, const MatrixSparse& a, const MatrixSparse& b, bool accumulate, bool denseOutput)
+void MatrixSparse::add(const MatrixSparse& a)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       X" << *this << " + A" << a << " := ...";
+        info(oss.str());
+    }
+
+    assert(!is1_ || !a.is1_ || (m_ == a.m_ && n_ == a.n_));
+    assert(precision_ == Precision::Single && a.precision_ == Precision::Single);
+
+    if (!a.is1_)
+    {
+    }
+    else if (!is1_)
+    {
+        copy(a);
+    }
+    else if (isDense_ && a.isDense_)
+    {
+        vsAdd(nnz(), vs_, a.vs_, vs_);
+    }
+    else if (isDense_)
+    {
+        // scatter a into our dense values
+        #pragma omp parallel for
+        for (ii i = 0; i < m_; i++)
+        {
+            for (ii nz = a.is0_[i]; nz < a.is1_[i]; nz++)
+                vs_[is0_[i] + a.js_[nz]] += a.vs_[nz];
+        }
+    }
+    else if (a.isDense_)
+    {
+        // scatter our values into a dense copy of a
+        MatrixSparse y;
+        y.copy(a);
+
+        #pragma omp parallel for
+        for (ii i = 0; i < m_; i++)
+        {
+            for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+                y.vs_[y.is0_[i] + js_[nz]] += vs_[nz];
+        }
+
+        swap(y);
+    }
+    else if (!addContained(a.is0_, a.is1_, a.js_, a.vs_))
+    {
+        MatrixSparse y;
+        y.add(1.0, false, a, *this);
+        swap(y);
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str(), this);
+    }
+}
+
+
+void MatrixSparse::matmul(bool transposeA, const MatrixSparse& a, const MatrixSparse& b, bool accumulate, bool denseOutput)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       " << (transposeA ? "t(" : "") << "A" << a << (transposeA ? ")" : "") << " %*% B" << b;
+        if (accumulate) oss << " + X" << *this;
+        oss << " := ...";
+        info(oss.str());
+    }
+
+    assert((transposeA ? a.m() : a.n()) == b.m());
+
+    if (!is1_)
+        accumulate = false;
+
+    if (a.is1_ && b.is1_)
+    {
+        if (a.isDense_ && (b.isDense_ || transposeA))
+        {
+            // MKL has no dense %*% dense or t(dense) %*% sparse, but neither arise with sparse basis operators
+            MatrixSparse t;
+            if (transposeA)
+            {
+                t.copy(a, true);
+                matmul(false, t, b, accumulate, denseOutput);
+            }
+            else
+            {
+                t.copy(b);
+                t.setDense(false);
+                matmul(false, a, t, accumulate, denseOutput);
+            }
+        }
+        else if (a.isDense_ || b.isDense_ || denseOutput)
+        {
+            ii m = transposeA ? a.n() : a.m();
+            ii n = b.n();
+
+            // accumulate straight into our values if they are already dense, otherwise add them in afterwards
+            bool inPlace = accumulate && isDense_;
+            MatrixSparse y;
+            if (!inPlace)
+                y.initDense(m, n);
+            fp* vs = inPlace ? vs_ : y.vs_;
+
+            struct matrix_descr descr;
+            descr.type = SPARSE_MATRIX_TYPE_GENERAL;
+
+            if (b.isDense_)
+            {
+                // Y = op(A) %*% B
+                status_ = mkl_sparse_s_mm(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE,
+                                          1.0, a.handle(), descr, SPARSE_LAYOUT_ROW_MAJOR, b.vs_, n, n, inPlace ? 1.0 : 0.0, vs, n);
+                assert(!status_);
+            }
+            else if (a.isDense_)
+            {
+                // t(Y) = t(B) %*% t(A), as row-major A and Y are column-major t(A) and t(Y)
+                status_ = mkl_sparse_s_mm(SPARSE_OPERATION_TRANSPOSE,
+                                          1.0, b.handle(), descr, SPARSE_LAYOUT_COLUMN_MAJOR, a.vs_, m, a.n_, inPlace ? 1.0 : 0.0, vs, n);
+                assert(!status_);
+            }
+            else
+            {
+                MatrixSparse t;
+                if (inPlace)
+                    t.initDense(m, n);
+
+                status_ = mkl_sparse_s_spmmd(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE,
+                                             a.handle(), b.handle(), SPARSE_LAYOUT_ROW_MAJOR, inPlace ? t.vs_ : vs, n);
+                assert(!status_);
+
+                if (inPlace)
+                    vsAdd(nnz(), vs_, t.vs_, vs_);
+            }
+
+            if (!inPlace)
+            {
+                if (accumulate)
+                {
+                    #pragma omp parallel for
+                    for (ii i = 0; i < m_; i++)
+                    {
+                        for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+                            y.vs_[y.is0_[i] + js_[nz]] += vs_[nz];
+                    }
+                }
+
+                swap(y);
+            }
+        }
+        else
+        {
+            // the number of products bounds the output, and decides if it is small enough to skip MKL
+            li nnzBound = 0;
+            bool small = li(a.nnz()) + b.nnz() + (accumulate ? nnz() : 0) <= SMALL_NNZ;
+            bool bound = small;
+#ifndef MKL_ILP64
+            // MKL cannot tell us the output is too large until it is too late, so check a cheap bound first and
+            // only count the products exactly if that could overflow
+            if (!small)
+            {
+                ii bMaxRowNnz = 0;
+                for (ii k = 0; k < b.m_; k++)
+                    bMaxRowNnz = max(bMaxRowNnz, b.is1_[k] - b.is0_[k]);
+
+                li mn = (li)(transposeA ? a.n_ : a.m_) * b.n_;
+                bound = min((li)a.nnz() * bMaxRowNnz, mn) + (accumulate ? nnz() : 0) > (li)numeric_limits<ii>::max();
+            }
+#endif
+            if (bound)
+            {
+                if (transposeA)
+                {
+                    for (ii k = 0; k < a.m_; k++)
+                        nnzBound += (li)(a.is1_[k] - a.is0_[k]) * (b.is1_[k] - b.is0_[k]);
+                }
+                else
+                {
+                    for (ii nz = 0; nz < a.is1_[a.m_ - 1]; nz++)
+                        nnzBound += b.is1_[a.js_[nz]] - b.is0_[a.js_[nz]];
+                }
+                checkIndex(min(nnzBound, (li)(transposeA ? a.n_ : a.m_) * b.n_) + (accumulate ? nnz() : 0), "matmul");
+            }
+
+            if (small && !isDense_ && nnzBound + (accumulate ? nnz() : 0) <= SMALL_NNZ)
+            {
+                // expand every product (and our own values if accumulating) then sum duplicates
+                ii is[SMALL_NNZ];
+                ii js[SMALL_NNZ];
+                fp vs[SMALL_NNZ];
+
+                ii length = 0;
+                if (accumulate)
+                {
+                    for (ii i = 0; i < m_; i++)
+                    {
+                        for (ii nz = is0_[i]; nz < is1_[i]; nz++, length++)
+                        {
+                            is[length] = i;
+                            js[length] = js_[nz];
+                            vs[length] = vs_[nz];
+                        }
+                    }
+                }
+
+                for (ii i = 0; i < a.m_; i++)
+                {
+                    for (ii a_nz = a.is0_[i]; a_nz < a.is1_[i]; a_nz++)
+                    {
+                        ii k = transposeA ? i : a.js_[a_nz];
+                        for (ii b_nz = b.is0_[k]; b_nz < b.is1_[k]; b_nz++, length++)
+                        {
+                            is[length] = transposeA ? a.js_[a_nz] : i;
+                            js[length] = b.js_[b_nz];
+                            vs[length] = a.vs_[a_nz] * b.vs_[b_nz];
+                        }
+                    }
+                }
+
+                copySmall(transposeA ? a.n() : a.m(), b.n(), length, is, js, vs);
+            }
+            else if (accumulate)
+            {
+                sparse_matrix_t t;
+                status_ = mkl_sparse_spmm(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE,
+                                          a.handle(), b.handle(), &t);
+
+                // annoying hack: it fails with this error when the output has no non-zeros
+                if (status_ != SPARSE_STATUS_ALLOC_FAILED)
+                {
+                    assert(!status_);
+
+                    if (isDense_)
+                    {
+                        // scatter the sparse product into our dense values
+                        sparse_index_base_t indexing;
+                        ii m, n;
+                        ii *is0, *is1, *js;
+                        fp* vs;
+                        status_ = mkl_sparse_s_export_csr(t, &indexing, &m, &n, &is0, &is1, &js, &vs);
+                        assert(!status_);
+
+                        #pragma omp parallel for
+                        for (ii i = 0; i < m; i++)
+                        {
+                            for (ii nz = is0[i]; nz < is1[i]; nz++)
+                                vs_[is0_[i] + js[nz]] += vs[nz];
+                        }
+
+                        status_ = mkl_sparse_destroy(t);
+                        assert(!status_);
+                    }
+                    else
+                    {
+                        sparse_index_base_t indexing;
+                        ii m, n;
+                        ii *is0, *is1, *js;
+                        fp* vs;
+                        status_ = mkl_sparse_s_export_csr(t, &indexing, &m, &n, &is0, &is1, &js, &vs);
+                        assert(!status_);
+
+                        // if our pattern already covers the product's we can add in place, otherwise merge
+                        if (addContained(is0, is1, js, vs))
+                        {
+                            status_ = mkl_sparse_destroy(t);
+                            assert(!status_);
+                        }
+                        else
+                        {
+                            sparse_matrix_t y;
+                            status_ = mkl_sparse_s_add(SPARSE_OPERATION_NON_TRANSPOSE, handle(), 1.0, t, &y);
+                            assert(!status_);
+
+                            status_ = mkl_sparse_destroy(t);
+                            assert(!status_);
+
+                            free();
+                            mat_ = y;
+
+                            status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
+                            assert(!status_);
+
+                            isOwned_ = false;
+                            isSorted_ = false;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                init(transposeA ? a.n() : a.m(), b.n());
+
+                status_ = mkl_sparse_spmm(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE,
+                                          a.handle(), b.handle(), &mat_);
+
+                // annoying hack: it fails with this error when the output has no non-zeros
+                if(status_ == SPARSE_STATUS_ALLOC_FAILED)
+                {
+                    init(transposeA ? a.n() : a.m(), b.n());
+                }
+                else
+                {
+                    assert(!status_);
+
+                    sparse_index_base_t indexing;
+                    status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
+                    assert(!status_);
+
+                    isOwned_ = false;
+                    isSorted_ = false;
+                }
+            }
+        }
+    }
+    else
+    {
+        if (!accumulate)
+        {
+            if (denseOutput)
+            {
+                initDense(transposeA ? a.n() : a.m(), b.n());
+                if (is1_)
+                {
+                    ippChunksParallel(nnz(), [&](li offset, int chunk)
+                    {
+                        ippsZero_32f(&vs_[offset], chunk);
+                    });
+                }
+            }
+            else
+            {
+                init(transposeA ? a.n() : a.m(), b.n());
+            }
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        if (isDense_) oss << " (DENSE)";
+        info(oss.str(), this);
+    }
+}
+
+
+void MatrixSparse::matmulBand(const MatrixSparse& a, const MatrixSparse& b, bool accumulate, bool sqrA)
 {
     if (getDebugLevel() % 10 >= 4)
     {
         ostringstream oss;
-        oss << getTimeStamp() << "       " << (transposeA ? "t(" : "") << "A" << a << (transposeA ? ")" : "") << " %*% B" << b;
+        oss << getTimeStamp() << "       " << (sqrA ? "sqr(A" : "A") << a << (sqrA ? ")" : "") << " %*% B" << b;
         if (accumulate) oss << " + X" << *this;
         oss << " := ...";
         info(oss.str());
     }
 
-    assert((transposeA ? a.m() : a.n()) == b.m());
+    assert(a.n_ == b.m_);
+    assert(!a.isDense_ && a.precision_ == Precision::Single && b.precision_ == Precision::Single);
 
     if (!is1_)
         accumulate = false;
+    assert(!accumulate || (m_ == a.m_ && n_ == b.n_ && precision_ == Precision::Single));
 
     if (a.is1_ && b.is1_)
     {
-        if (!accumulate)
-            init(transposeA ? a.n() : a.m(), b.n());
+        ii m = a.m_;
+        ii n = b.n_;
 
-        if (denseOutput)
+        if (b.isDense_)
         {
-            ii m = transposeA ? a.n() : a.m();
-            ii n = b.n();
-
-            ii* is0 = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
-            is0[0] = 0;
-            ii* is1 = is0 + 1;
+            // every row of the output is dense, a weighted sum of a few whole rows of b built a tile at a time
+            MatrixSparse t;
+            bool inPlace = accumulate && isDense_;
+            if (!inPlace)
+                t.initDense(m, n);
+            fp* vs = inPlace ? vs_ : t.vs_;
+
+            #pragma omp parallel for
             for (ii i = 0; i < m; i++)
-                is1[i] = is0[i] + n;
-
-            ii* js = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1[m - 1], 64));
-            for (ii nz = 0; nz < is1[m - 1]; nz++)
-                js[nz] = nz % n;
-
-            fp* vs = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1[m - 1], 64));
-            status_ = mkl_sparse_s_spmmd(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE, a.mat_, b.mat_, SPARSE_LAYOUT_ROW_MAJOR, vs, n); assert(!status_);
-
-            sparse_matrix_t t;
-            status_ = mkl_sparse_s_create_csr(&t, SPARSE_INDEX_BASE_ZERO, m, n, is0, is1, js, vs);
-            assert(!status_);
-
-            if (accumulate)
             {
-                sparse_matrix_t y;
-                status_ = mkl_sparse_s_add(SPARSE_OPERATION_NON_TRANSPOSE, mat_, 1.0, t, &y);
-                assert(!status_);
-
-                status_ = mkl_sparse_destroy(t);
-                assert(!status_);
-
-                free();
-                mat_ = y;
+                fp* ys = &vs[(li)i * n];
+                if (!inPlace)
+                {
+                    for (ii j = 0; j < n; j++)
+                        ys[j] = 0.0;
 
-                sparse_index_base_t indexing;
-                status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
-                assert(!status_);
+                    if (accumulate)
+                    {
+                        for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+                            ys[column(i, nz)] += vs_[nz];
+                    }
+                }
 
-                isOwned_ = false;
-            }
-            else
-            {
-                m_ = m;
-                n_ = n;
-                is0_ = is0;
-                is1_ = is1;
-                js_ = js;
-                vs_ = vs;
-                mat_ = t;
-                isOwned_ = true;
+                for (ii j0 = 0; j0 < n; j0 += BAND_TILE)
+                {
+                    ii j1 = j0 + BAND_TILE < n ? j0 + BAND_TILE : n;
+                    for (ii a_nz = a.is0_[i]; a_nz < a.is1_[i]; a_nz++)
+                    {
+                        fp w = sqrA ? a.vs_[a_nz] * a.vs_[a_nz] : a.vs_[a_nz];
+                        const fp* xs = &b.vs_[(li)a.js_[a_nz] * n];
+                        for (ii j = j0; j < j1; j++)
+                            ys[j] += w * xs[j];
+                    }
+                }
             }
 
-            isSorted_ = true;
+            if (!inPlace)
+                swap(t);
         }
         else
         {
-            if (accumulate)
+            // each output row merges the few sorted rows of b selected by a row of a, plus our own row if accumulating
+            b.sort();
+            if (accumulate && isDense_)
+                setDense(false);
+            else if (accumulate)
+                sort();
+
+            MatrixSparse t;
+            t.init(m, n);
+            t.is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+            t.is0_[0] = 0;
+            t.is1_ = t.is0_ + 1;
+
+            auto mergeRow = [&](ii i, ii* js, fp* vs, vector<ii>& cs, vector<ii>& es, vector<fp>& ws, vector<const ii*>& jss, vector<const fp*>& vss)
             {
-                sparse_matrix_t t;
-                status_ = mkl_sparse_spmm(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE,
-                                          a.mat_, b.mat_, &t);
+                cs.clear(); es.clear(); ws.clear(); jss.clear(); vss.clear();
+                if (accumulate && is1_[i] > is0_[i])
+                {
+                    cs.push_back(is0_[i]); es.push_back(is1_[i]); ws.push_back(1.0);
+                    jss.push_back(js_); vss.push_back(vs_);
+                }
+                for (ii a_nz = a.is0_[i]; a_nz < a.is1_[i]; a_nz++)
+                {
+                    ii r = a.js_[a_nz];
+                    if (b.is1_[r] > b.is0_[r])
+                    {
+                        cs.push_back(b.is0_[r]); es.push_back(b.is1_[r]);
+                        ws.push_back(sqrA ? a.vs_[a_nz] * a.vs_[a_nz] : a.vs_[a_nz]);
+                        jss.push_back(b.js_); vss.push_back(b.vs_);
+                    }
+                }
 
-                // annoying hack: it fails with this error when the output has no non-zeros
-                if (status_ != SPARSE_STATUS_ALLOC_FAILED)
+                ii length = 0;
+                for (;;)
                 {
-                    assert(!status_);
+                    ii j = numeric_limits<ii>::max();
+                    for (size_t s = 0; s < cs.size(); s++)
+                    {
+                        if (cs[s] < es[s] && jss[s][cs[s]] < j)
+                            j = jss[s][cs[s]];
+                    }
+                    if (j == numeric_limits<ii>::max())
+                        break;
 
-                    sparse_matrix_t y;
-                    status_ = mkl_sparse_s_add(SPARSE_OPERATION_NON_TRANSPOSE, mat_, 1.0, t, &y);
-                    assert(!status_);
+                    fp v = 0.0;
+                    for (size_t s = 0; s < cs.size(); s++)
+                    {
+                        if (cs[s] < es[s] && jss[s][cs[s]] == j)
+                        {
+                            if (vs) v += ws[s] * vss[s][cs[s]];
+                            cs[s]++;
+                        }
+                    }
 
-                    status_ = mkl_sparse_destroy(t);
-                    assert(!status_);
+                    if (js)
+                    {
+                        js[length] = j;
+                        vs[length] = v;
+                    }
+                    length++;
+                }
 
-                    free();
-                    mat_ = y;
+                return length;
+            };
 
-                    sparse_index_base_t indexing;
-                    status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
-                    assert(!status_);
-                }
+            // first pass counts the non-zeros of each row, second pass fills them
+            #pragma omp parallel
+            {
+                vector<ii> cs, es;
+                vector<fp> ws;
+                vector<const ii*> jss;
+                vector<const fp*> vss;
+
+                #pragma omp for
+                for (ii i = 0; i < m; i++)
+                    t.is1_[i] = mergeRow(i, 0, 0, cs, es, ws, jss, vss);
             }
-            else
+
+            // total the counts before the prefix sum can overflow
+            li nnz = 0;
+            for (ii i = 0; i < m; i++)
+                nnz += t.is1_[i];
+
+            try
             {
-                status_ = mkl_sparse_spmm(transposeA ? SPARSE_OPERATION_TRANSPOSE : SPARSE_OPERATION_NON_TRANSPOSE,
-                                          a.mat_, b.mat_, &mat_);
+                checkIndex(nnz, "matmulBand");
+            }
+            catch (...)
+            {
+                mkl_free(t.is0_);
+                t.is1_ = 0;
+                throw;
+            }
 
-                // annoying hack: it fails with this error when the output has no non-zeros
-                if(status_ == SPARSE_STATUS_ALLOC_FAILED)
+            for (ii i = 0; i < m; i++)
+                t.is1_[i] += t.is0_[i];
+
+            if (nnz > 0)
+            {
+                t.js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * nnz, 64));
+                t.vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * nnz, 64));
+
+                #pragma omp parallel
                 {
-                    init(transposeA ? a.n() : a.m(), b.n());
+                    vector<ii> cs, es;
+                    vector<fp> ws;
+                    vector<const ii*> jss;
+                    vector<const fp*> vss;
+
+                    #pragma omp for
+                    for (ii i = 0; i < m; i++)
+                        mergeRow(i, &t.js_[t.is0_[i]], &t.vs_[t.is0_[i]], cs, es, ws, jss, vss);
                 }
-                else
-                {
-                    assert(!status_);
 
-                    sparse_index_base_t indexing;
-                    status_ = mkl_sparse_s_export_csr(mat_, &indexing, &m_, &n_, &is0_, &is1_, &js_, &vs_);
-                    assert(!status_);
-                }
+                t.isOwned_ = true;
+                t.isSorted_ = true;
+                swap(t);
+            }
+            else
+            {
+                mkl_free(t.is0_);
+                t.is1_ = 0;
+                init(m, n);
             }
-
-            isOwned_ = false;
-            isSorted_ = false;
         }
     }
-    else
+    else if (!accumulate)
     {
-        if (!accumulate)
-        {
-            if (denseOutput)
-                copy(transposeA ? a.n() : a.m(), b.n(), fp(0.0));
-            else
-                init(transposeA ? a.n() : a.m(), b.n());
-        }
+        init(a.m_, b.n_);
     }
 
     if (getDebugLevel() % 10 >= 4)
     {
         ostringstream oss;
         oss << getTimeStamp() << "       ... X" << *this;
-        if (denseOutput) oss << " (DENSE)";
-        oss;
+        if (isDense_) oss << " (DENSE)";
         info(oss.str(), this);
     }
 }
@@ -899,7 +2272,12 @@ void MatrixSparse::mul(fp beta)
     }
 
     if (is1_)
-        ippsMulC_32f_I(beta, vs_, is1_[m_ - 1]);
+    {
+        ippChunksParallel(is1_[m_ - 1], [&](li offset, int chunk)
+        {
+            ippsMulC_32f_I(beta, &vs_[offset], chunk);
+        });
+    }
 
     if (getDebugLevel() % 10 >= 4)
     {
@@ -924,13 +2302,12 @@ void MatrixSparse::mul(const MatrixSparse& a)
         sort();
         a.sort();
 
-        assert(is1_[m_ - 1] == a.is1_[m_ - 1]);
-        for (ii i = 0; i < m_; i++)
-            assert(is0_[i] == a.is0_[i]);
-        for (ii nz = 0; nz < is1_[m_ - 1]; nz++)
-            assert(js_[nz] == a.js_[nz]);
+        assert(isSamePattern(a));
 
-        vsMul(is1_[m_ - 1], vs_, a.vs_, vs_);
+        a.forValues([&](li offset, ii length, const fp* vs)
+        {
+            vsMul(length, &vs_[offset], vs, &vs_[offset]);
+        });
     }
 
     if (getDebugLevel() % 10 >= 4)
@@ -976,17 +2353,27 @@ void MatrixSparse::sqr(const MatrixSparse& a)
 
     if (a.is1_)
     {
-        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
-        ippsCopy_32s(a.is0_, is0_, m_ + 1);
-        is1_ = is0_ + 1;
-        js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
-        ippsCopy_32s(a.js_, js_, is1_[m_ - 1]);
-        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+        if (a.isDense_)
+        {
+            initDense(m_, n_);
+        }
+        else
+        {
+            is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
+            copyIndices(a.is0_, is0_, m_ + 1);
+            is1_ = is0_ + 1;
+            js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
+            copyIndices(a.js_, js_, is1_[m_ - 1]);
+            vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+        }
 
         vsSqr(is1_[m_ - 1], a.vs_, vs_);
 
-        status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
-        assert(!status_);
+        if (!isDense_)
+        {
+            status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
+            assert(!status_);
+        }
 
         isOwned_ = true;
         isSorted_ = a.isSorted_;
@@ -1055,7 +2442,12 @@ void MatrixSparse::censorLeft(fp threshold)
     }
 
     if (is1_)
-        ippsThreshold_LT_32f(vs_, vs_, is1_[m_ - 1], threshold);
+    {
+        ippChunksParallel(is1_[m_ - 1], [&](li offset, int chunk)
+        {
+            ippsThreshold_LT_32f(&vs_[offset], &vs_[offset], chunk, threshold);
+        });
+    }
 
     if (getDebugLevel() % 10 >= 4)
     {
@@ -1078,7 +2470,23 @@ void MatrixSparse::addNonzeros(fp beta)
     }
 
     if (is1_)
-        ippsAddC_32f_I(beta, vs_, is1_[m_ - 1]);
+    {
+        if (precision_ == Precision::Single)
+        {
+            ippChunksParallel(is1_[m_ - 1], [&](li offset, int chunk)
+            {
+                ippsAddC_32f_I(beta, &vs_[offset], chunk);
+            });
+        }
+        else
+        {
+            forValues([&](li offset, ii length, fp* vs)
+            {
+                ippsAddC_32f_I(beta, vs, length);
+                toPrecision(precision_, vs, &hs_[offset], length);
+            });
+        }
+    }
 
     if (getDebugLevel() % 10 >= 4)
     {
@@ -1103,13 +2511,12 @@ void MatrixSparse::addNonzeros(const MatrixSparse& a)
         sort();
         a.sort();
 
-        assert(is1_[m_ - 1] == a.is1_[m_ - 1]);
-        for (ii i = 0; i < m_; i++)
-            assert(is0_[i] == a.is0_[i]);
-        for (ii nz = 0; nz < is1_[m_ - 1]; nz++)
-            assert(js_[nz] == a.js_[nz]);
+        assert(isSamePattern(a));
 
-        vsAdd(is1_[m_ - 1], vs_, a.vs_, vs_);
+        a.forValues([&](li offset, ii length, const fp* vs)
+        {
+            vsAdd(length, &vs_[offset], vs, &vs_[offset]);
+        });
     }
 
     if (getDebugLevel() % 10 >= 4)
@@ -1163,22 +2570,35 @@ void MatrixSparse::lnNonzeros(const MatrixSparse& a)
 
     if (a.is1_)
     {
-        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
-        ippsCopy_32s(a.is0_, is0_, m_ + 1);
-        is1_ = is0_ + 1;
-        js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
-        ippsCopy_32s(a.js_, js_, is1_[m_ - 1]);
-        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+        if (a.isDense_)
+        {
+            initDense(m_, n_);
+        }
+        else
+        {
+            is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
+            copyIndices(a.is0_, is0_, m_ + 1);
+            is1_ = is0_ + 1;
+            js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
+            copyIndices(a.js_, js_, is1_[m_ - 1]);
+            vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+        }
 
+        a.forValues([&](li offset, ii length, const fp* vs)
+        {
 #ifdef NDEBUG
-        vsLn(is1_[m_ - 1], a.vs_, vs_); // for some reason this causes valgrind to crash
+            vsLn(length, vs, &vs_[offset]); // for some reason this causes valgrind to crash
 #else
-        for (ii i = 0; i < is1_[m_ - 1]; i++)
-            vs_[i] = log(a.vs_[i]);
+            for (ii i = 0; i < length; i++)
+                vs_[offset + i] = log(vs[i]);
 #endif
+        });
 
-        status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
-        assert(!status_);
+        if (!isDense_)
+        {
+            status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
+            assert(!status_);
+        }
 
         isOwned_ = true;
         isSorted_ = a.isSorted_;
@@ -1228,13 +2648,12 @@ void MatrixSparse::divNonzeros(const MatrixSparse& a)
         sort();
         a.sort();
 
-        assert(is1_[m_ - 1] == a.is1_[m_ - 1]);
-        for (ii i = 0; i < m_; i++)
-            assert(is0_[i] == a.is0_[i]);
-        for (ii nz = 0; nz < is1_[m_ - 1]; nz++)
-            assert(js_[nz] == a.js_[nz]);
+        assert(isSamePattern(a));
 
-        vsDiv(is1_[m_ - 1], vs_, a.vs_, vs_);
+        a.forValues([&](li offset, ii length, const fp* vs)
+        {
+            vsDiv(length, &vs_[offset], vs, &vs_[offset]);
+        });
     }
 
     if (getDebugLevel() % 10 >= 4)
@@ -1262,23 +2681,32 @@ void MatrixSparse::divNonzeros(const MatrixSparse& a, const MatrixSparse& b)
         a.sort();
         b.sort();
 
-        assert(a.is1_[m_ - 1] == b.is1_[m_ - 1]);
-        for (ii i = 0; i < m_; i++)
-            assert(a.is0_[i] == b.is0_[i]);
-        for (ii nz = 0; nz < a.is1_[m_ - 1]; nz++)
-            assert(a.js_[nz] == b.js_[nz]);
+        assert(a.isSamePattern(b));
 
-        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
-        ippsCopy_32s(a.is0_, is0_, m_ + 1);
-        is1_ = is0_ + 1;
-        js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
-        ippsCopy_32s(a.js_, js_, is1_[m_ - 1]);
-        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+        if (a.isDense_)
+        {
+            initDense(m_, n_);
+        }
+        else
+        {
+            is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m_ + 1), 64));
+            copyIndices(a.is0_, is0_, m_ + 1);
+            is1_ = is0_ + 1;
+            js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m_ - 1], 64));
+            copyIndices(a.js_, js_, is1_[m_ - 1]);
+            vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m_ - 1], 64));
+        }
 
-        vsDiv(is1_[m_ - 1], a.vs_, b.vs_, vs_);
+        b.forValues([&](li offset, ii length, const fp* vs)
+        {
+            vsDiv(length, &a.vs_[offset], vs, &vs_[offset]);
+        });
 
-        status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
-        assert(!status_);
+        if (!isDense_)
+        {
+            status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
+            assert(!status_);
+        }
 
         isOwned_ = true;
         isSorted_ = true;
@@ -1307,11 +2735,7 @@ void MatrixSparse::div2Nonzeros(const MatrixSparse& a)
         sort();
         a.sort();
 
-        assert(is1_[m_ - 1] == a.is1_[m_ - 1]);
-        for (ii i = 0; i < m_; i++)
-            assert(is0_[i] == a.is0_[i]);
-        for (ii nz = 0; nz < is1_[m_ - 1]; nz++)
-            assert(js_[nz] == a.js_[nz]);
+        assert(isSamePattern(a));
 
         vsDiv(is1_[m_ - 1], a.vs_, vs_, vs_);
     }
@@ -1335,13 +2759,28 @@ void MatrixSparse::div2(const Matrix &a)
     }
 
     sort();
-    assert(nnz() == size());
-    assert(m_ = a.m());
-    assert(n_ = a.n());
+    assert(m_ == a.m());
+    assert(n_ == a.n());
 
     if (is1_)
     {
-        vsDiv(is1_[m_ - 1], a.vs(), vs_, vs_);
+        if (nnz() == size())
+        {
+            vsDiv(is1_[m_ - 1], a.vs(), vs_, vs_);
+        }
+        else
+        {
+            // rows left empty (e.g. observations not synthesised) are skipped
+            #pragma omp parallel for
+            for (ii i = 0; i < m_; i++)
+            {
+                if (is1_[i] > is0_[i])
+                {
+                    assert(is1_[i] - is0_[i] == n_);
+                    vsDiv(n_, &a.vs()[li(i) * n_], &vs_[is0_[i]], &vs_[is0_[i]]);
+                }
+            }
+        }
 
         //for (ii i = 0; i < is1_[m_ - 1]; i++)
         //    vs_[i] = vs_[i] > 0.0 ? a.vs()[i] / vs_[i] : 0.0;
@@ -1367,7 +2806,14 @@ fp MatrixSparse::sum() const
 
     fp sum = 0.0;
     if (is1_)
-        ippsSum_32f(vs_, is1_[m_ - 1], &sum, ippAlgHintFast);
+    {
+        ippChunks(is1_[m_ - 1], [&](li offset, int chunk)
+        {
+            fp sumChunk;
+            ippsSum_32f(&vs_[offset], chunk, &sumChunk, ippAlgHintFast);
+            sum += sumChunk;
+        });
+    }
 
     if (getDebugLevel() % 10 >= 4)
     {
@@ -1394,8 +2840,12 @@ fp MatrixSparse::sumSqrs() const
     fp sum = 0.0;
     if (is1_)
     {
-        ippsNorm_L2_32f(vs_, is1_[m_ - 1], &sum);
-        sum *= sum;
+        ippChunks(is1_[m_ - 1], [&](li offset, int chunk)
+        {
+            fp normChunk;
+            ippsNorm_L2_32f(&vs_[offset], chunk, &normChunk);
+            sum += normChunk * normChunk;
+        });
     }
 
     if (getDebugLevel() % 10 >= 4)
@@ -1426,14 +2876,14 @@ fp MatrixSparse::sumSqrDiffsNonzeros(const MatrixSparse& a) const
         sort();
         a.sort();
 
-        assert(is1_[m_ - 1] == a.is1_[m_ - 1]);
-        for (ii i = 0; i < m_; i++)
-            assert(is0_[i] == a.is0_[i]);
-        for (ii nz = 0; nz < is1_[m_ - 1]; nz++)
-            assert(js_[nz] == a.js_[nz]);
+        assert(isSamePattern(a));
 
-        ippsNormDiff_L2_32f(vs_, a.vs_, is1_[m_ - 1], &sum);
-        sum *= sum;
+        ippChunks(is1_[m_ - 1], [&](li offset, int chunk)
+        {
+            fp normChunk;
+            ippsNormDiff_L2_32f(&vs_[offset], &a.vs_[offset], chunk, &normChunk);
+            sum += normChunk * normChunk;
+        });
     }
 
     if (getDebugLevel() % 10 >= 4)
@@ -1449,6 +2899,44 @@ fp MatrixSparse::sumSqrDiffsNonzeros(const MatrixSparse& a) const
 }
 
 
+void MatrixSparse::sumSqrDiffsRows(const MatrixSparse& a, vector<double>& sumSqrs, vector<double>& sumSqrDiffs) const
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       sumSqrDiffsRows(X" << *this << ", A" << a << ") := ...";
+        info(oss.str());
+    }
+
+    assert(ii(sumSqrs.size()) == m_ && ii(sumSqrDiffs.size()) == m_);
+
+    if (is1_)
+    {
+        sort();
+        a.sort();
+
+        assert(isSamePattern(a));
+        assert(precision_ == Precision::Single && a.precision_ == Precision::Single);
+
+        #pragma omp parallel for
+        for (ii i = 0; i < m_; i++)
+        {
+            double sumSqrsRow = 0.0;
+            double sumSqrDiffsRow = 0.0;
+            for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+            {
+                double diff = double(a.vs_[nz]) - vs_[nz];
+                sumSqrsRow += double(a.vs_[nz]) * a.vs_[nz];
+                sumSqrDiffsRow += diff * diff;
+            }
+
+            sumSqrs[i] += sumSqrsRow;
+            sumSqrDiffs[i] += sumSqrDiffsRow;
+        }
+    }
+}
+
+
 double MatrixSparse::sortElapsed_ = 0.0;
 
 
@@ -1495,15 +2983,23 @@ void MatrixSparse::sort() const
                     {
                         if (is1_[i] > is0_[i])
                         {
-                            ii bufSize;
+                            ii* idxs = static_cast<ii*>(mkl_malloc(sizeof(ii) * (is1_[i] - is0_[i]), 64));
+#ifdef MKL_ILP64
+                            // IPP radix index sort only takes 32 bit keys
+                            for (ii nz = 0; nz < is1_[i] - is0_[i]; nz++)
+                                idxs[nz] = nz;
+                            const ii* js = &js_[is0_[i]];
+                            stable_sort(idxs, idxs + (is1_[i] - is0_[i]), [js](ii a, ii b) { return js[a] < js[b]; });
+#else
+                            int bufSize;
                             ippsSortRadixIndexGetBufferSize(is1_[i] - is0_[i], ipp32s, &bufSize);
                             Ipp8u* buffer = static_cast<Ipp8u*>(mkl_malloc(sizeof(Ipp8u) * bufSize, 64));
 
-                            ii* idxs = static_cast<ii*>(mkl_malloc(sizeof(ii) * (is1_[i] - is0_[i]), 64));
                             ippsSortRadixIndexAscend_32s(&js_[is0_[i]], sizeof(ii), idxs, is1_[i] - is0_[i], buffer);
                             mkl_free(buffer);
+#endif
 
-                            ii* newJs = static_cast<ii*>(mkl_malloc(sizeof(fp) * (is1_[i] - is0_[i]), 64));
+                            ii* newJs = static_cast<ii*>(mkl_malloc(sizeof(ii) * (is1_[i] - is0_[i]), 64));
                             for (ii nz = 0; nz < is1_[i] - is0_[i]; nz++)
                                 newJs[nz] = js_[is0_[i] + idxs[nz]];
 
@@ -1511,10 +3007,10 @@ void MatrixSparse::sort() const
                             vsPackV(is1_[i] - is0_[i], &vs_[is0_[i]], idxs, newVs);
                             mkl_free(idxs);
 
-                            ippsCopy_32s(newJs, &js_[is0_[i]], is1_[i] - is0_[i]);
+                            copyIndices(newJs, &js_[is0_[i]], is1_[i] - is0_[i]);
                             mkl_free(newJs);
 
-                            ippsCopy_32f(newVs, &vs_[is0_[i]], is1_[i] - is0_[i]);
+                            copyValues(newVs, &vs_[is0_[i]], is1_[i] - is0_[i]);
                             mkl_free(newVs);
                         }
                     }
@@ -1563,7 +3059,7 @@ ostream& operator<<(ostream& os, const MatrixSparse& a)
 }
 
 
-MatrixSparseView::MatrixSparseView(const MatrixSparse &a, ii row) : isOwned_(false)
+MatrixSparseView::MatrixSparseView(const MatrixSparse &a, ii row)
 {
     if (getDebugLevel() % 10 >= 4)
     {
@@ -1576,26 +3072,41 @@ MatrixSparseView::MatrixSparseView(const MatrixSparse &a, ii row) : isOwned_(fal
 
     init(1, a.n_);
 
-    if (a.nnz() > 0)
+    if (a.nnz() > 0 && a.is1_[row] > a.is0_[row])
     {
-        ii newNnz = a.is1_[row] - a.is0_[row];
+        is_[0] = 0;
+        is_[1] = a.is1_[row] - a.is0_[row];
+        view(a, row, is_);
+    }
 
-        if (newNnz > 0)
-        {
-            is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * 2, 64));
-            is0_[0] = 0;
-            is1_ = is0_ + 1;
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str(), this);
+    }
+}
 
-            is1_[0] = newNnz;
-            js_ = &a.js_[a.is0_[row]];
-            vs_ = &a.vs_[a.is0_[row]];
 
-            status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
-            assert(!status_);
+MatrixSparseView::MatrixSparseView(const MatrixSparse &a, ii row, ii m)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       A" << a << "[" << row << ":" << row + m << "] := ...";
+        info(oss.str());
+    }
 
-            isOwned_ = true;
-            isSorted_ = a.isSorted_;
-        }
+    assert(row >= 0 && m >= 0 && row + m <= a.m_);
+
+    init(m, a.n_);
+
+    if (a.nnz() > 0 && m > 0 && a.is0_[row + m] > a.is0_[row])
+    {
+        iss_.resize(m + 1);
+        for (ii i = 0; i <= m; i++)
+            iss_[i] = a.is0_[row + i] - a.is0_[row];
+        view(a, row, iss_.data());
     }
 
     if (getDebugLevel() % 10 >= 4)
@@ -1607,10 +3118,15 @@ MatrixSparseView::MatrixSparseView(const MatrixSparse &a, ii row) : isOwned_(fal
 }
 
 
-MatrixSparseView::~MatrixSparseView()
+void MatrixSparseView::view(const MatrixSparse &a, ii row, ii* is)
 {
-    if (isOwned_)
-    {
-        mkl_free(is0_);
-    }
+    assert(a.precision_ == Precision::Single);
+
+    // borrow a's non-zeros, the MKL handle is only created if an MKL routine is called on us
+    is0_ = is;
+    is1_ = is + 1;
+    js_ = a.isDense_ ? 0 : &a.js_[a.is0_[row]];
+    vs_ = &a.vs_[a.is0_[row]];
+    isDense_ = a.isDense_;
+    isSorted_ = a.isSorted_;
 }
@@ -30,11 +30,21 @@
 
 
 class MatrixSparseView;
+class MatrixSparseBatch;
 
 
 class MatrixSparse : public SubjectMatrixSparse
 {
 public:
+    // storage precision of the non-zero values; compute is always in fp, with 16 bit storage converted in cache-sized
+    // chunks as it is streamed through. Only operations marked (16 bit) accept a matrix not stored as Single.
+    enum class Precision { Single, Half, Bfloat16 };
+
+    // a matrix with every element non-zero (e.g. a coarse basis level) can be stored densely: the values are row-major,
+    // there are no column indices and no MKL handle. Elementwise operations on values alone always accept it, operations
+    // with other matrix arguments only where marked (dense). Outputs that share the pattern of a dense input stay dense,
+    // and copyPrune switches to dense storage automatically when nothing is pruned from a full matrix.
+
     MatrixSparse(ii m = 0, ii n = 0);
     ~MatrixSparse();
 
@@ -49,58 +59,89 @@ public:
     ii nnz() const;
     ii nnzActual() const;
     fp* vs() const;
+    Precision getPrecision() const;
+    void setPrecision(Precision precision); // convert value storage in place
+    bool isDense() const;
+    void setDense(bool dense); // convert between CSR and dense storage in place, only possible if nnz() == size()
+    void prepareConcurrentReads() const; // sort now and create any MKL handle, which are otherwise done on first read and so cannot be shared between threads
 
     // these functions allocate memory
-    void copy(const MatrixSparse& a, bool transpose = false);
+    void copy(const MatrixSparse& a, bool transpose = false); // (16 bit) a, output is Single (dense)
     void copy(ii m, ii n, ii nnz, const ii* rowind, const ii* colind, const fp* acoo); // create from COO matrix
     void copy(const Matrix& a); // create from dense matrix a
     void copy(ii m, ii n, fp v); // create from dense matrix of constant value
-    void copyConcatenate(const std::vector<MatrixSparse>& xs); // the xs must be row vectors
-    void copySubset(const MatrixSparse& a); // only non-zero elements of this matrix are overwritten by corresponding elements in a
-    void copySubset(const MatrixSparse& a, const MatrixSparse& b); // only non-zero elements of b are copied from a to this matrix
-    ii copyPrune(const MatrixSparse &a, fp threshold = 0.0); // prune values under threshold
-    ii copyPruneRows(const MatrixSparse& a, const MatrixSparse& b, bool bRows, fp threshold); // prune rows of this matrix when rows or columns of a are empty
+    template<typename CountRow, typename FillRow>
+    void copyRows(ii m, ii n, CountRow countRow, FillRow fillRow, bool sorted = true); // create directly in CSR: countRow(i) returns the nnz of row i, then fillRow(i, js, vs) writes it
+    void copyRows(const MatrixSparse& a, const std::vector<char>& rows); // (dense) a with only the rows i with rows[i] set, the others left empty
+    void copyConcatenate(const std::vector<MatrixSparse>& xs); // (dense) the xs must be row vectors
+    void copySubset(const MatrixSparse& a); // (dense) only non-zero elements of this matrix are overwritten by corresponding elements in a
+    void copySubset(const MatrixSparse& a, const std::vector<char>& rows); // (dense) as copySubset(a), but only in the rows i with rows[i] set
+    void copySubset(const MatrixSparse& a, const MatrixSparse& b); // (16 bit) a, output keeps a's precision. (dense) Only non-zero elements of b are copied from a to this matrix, as zero where a has none
+    ii copyPrune(const MatrixSparse &a, fp threshold = 0.0); // (dense) prune values under threshold, output is dense if none are
+    ii copyPruneRows(const MatrixSparse& a, const MatrixSparse& b, bool bRows, fp threshold); // (dense) b, prune rows of this matrix when rows or columns of a are empty
+
+    // these functions compact in place, only reallocating if a large fraction of memory can be reclaimed
+    ii prune(fp threshold = 0.0); // (16 bit) (dense) as copyPrune(*this, threshold), keeping our precision
+    ii pruneRows(const MatrixSparse& b, bool bRows, fp threshold); // (dense) b, as copyPruneRows(*this, b, bRows, threshold)
+    ii pruneColumns(const MatrixSparse& aT); // (dense) follow aT.pruneRows on our transpose aT by dropping the columns that are now empty rows of aT, without transposing it again
+    ii pruneUpdate(fp threshold, const MatrixSparse& x, const std::vector<MatrixSparse*>& as, fp& sumSqrs, fp& sumSqrDiffs); // (dense) as prune(threshold) while adding sum(x^2) and sum((x - this)^2) over our non-zeros, and applying the same pruning to each of as
 
     // exports
-    void exportTo(ii* rowind, ii* colind, fp* acoo) const; // export as COO matrix
-    void exportTo(fp *vs) const; // export as dense matrix
+    void exportTo(ii* rowind, ii* colind, fp* acoo) const; // (16 bit) (dense) export as COO matrix
+    void exportTo(fp *vs) const; // (dense) export as dense matrix
 
     // elementwise operations
     void add(fp alpha, bool transposeA, const MatrixSparse& a, const MatrixSparse& b);
-    void matmul(bool transposeA, const MatrixSparse& a, const MatrixSparse& b, bool accumulate, bool denseOutput = false);
+    void add(const MatrixSparse& a); // (dense) add a to this matrix, in place if our pattern contains a's
+    void matmul(bool transposeA, const MatrixSparse& a, const MatrixSparse& b, bool accumulate, bool denseOutput = false); // (dense) output is dense if either input is or denseOutput
+    void matmulBand(const MatrixSparse& a, const MatrixSparse& b, bool accumulate, bool sqrA = false); // (dense) b, as matmul(false, a, b) (or sqr(a)) but without MKL, for a with only a few non-zeros per row
     void mul(fp beta);
-    void mul(const MatrixSparse& a);
+    void mul(const MatrixSparse& a); // (16 bit) a (dense)
     void sqr();
-    void sqr(const MatrixSparse& a);
+    void sqr(const MatrixSparse& a); // (dense)
     void sqrt();
     void pow(fp power);
     void censorLeft(fp threshold);
 
     // elementwise operations only operating on non-zero elements
-    void addNonzeros(fp beta);
-    void addNonzeros(const MatrixSparse& a);
+    void addNonzeros(fp beta); // (16 bit)
+    void addNonzeros(const MatrixSparse& a); // (16 bit) a (dense)
     void lnNonzeros();
-    void lnNonzeros(const MatrixSparse& a);
+    void lnNonzeros(const MatrixSparse& a); // (16 bit) a (dense)
     void expNonzeros();
-    void divNonzeros(const MatrixSparse& b); // a is denominator
-    void divNonzeros(const MatrixSparse& a, const MatrixSparse& b); // a/b
-    void div2Nonzeros(const MatrixSparse& a); // a is numerator
-    void div2(const Matrix &a); // a is numerator & must be dense
+    void divNonzeros(const MatrixSparse& a); // (16 bit) a (dense), a is denominator
+    void divNonzeros(const MatrixSparse& a, const MatrixSparse& b); // (16 bit) b (dense), a/b
+    void div2Nonzeros(const MatrixSparse& a); // (dense) a is numerator
+    void div2(const Matrix &a); // (dense) a is numerator & must be dense, each of our rows must be complete or empty
 
     // aggregate operations
     fp sum() const;
     fp sumSqrs() const;
-    fp sumSqrDiffsNonzeros(const MatrixSparse& a) const;
+    fp sumSqrDiffsNonzeros(const MatrixSparse& a) const; // (dense)
+    void sumSqrDiffsRows(const MatrixSparse& a, std::vector<double>& sumSqrs, std::vector<double>& sumSqrDiffs) const; // (dense) add sum(a[i,]^2) and sum((a[i,] - this[i,])^2) to element i of each, a with our pattern
 
     static double sortElapsed_;
 
 protected:
     void sort() const;
+    void initDense(ii m, ii n); // allocate dense storage with uninitialised values
+    void copySmall(ii m, ii n, ii length, const ii* rowind, const ii* colind, const fp* acoo); // COO to CSR without MKL, duplicates are summed
+    ii column(ii i, ii nz) const; // column of non-zero nz in row i
+    ii pruneRowsLengths(const MatrixSparse& b, bool bRows, fp threshold, std::vector<ii>& lengths) const; // if enough rows can be pruned, returns how many and their new lengths
+    void compact(std::vector<ii>& lengths); // keep the first lengths[i] non-zeros of each row i
+    bool addContained(const ii* is0, const ii* is1, const ii* js, const fp* vs); // add CSR values in place if our pattern contains theirs, otherwise return false untouched
+    sparse_matrix_t handle() const; // MKL handle, created on first use if we are a view or were built by copySmall
+    bool isSamePattern(const MatrixSparse& a) const; // both sorted with identical non-zero positions
+    template<typename Function>
+    void forValues(Function f) const; // calls f(offset, length, vs) over the values as fp, chunked if stored in 16 bit
 
     ii m_; // number of rows
     ii n_; // number of columns
     
     ii* is0_; ii* is1_; ii* js_; fp* vs_; // pointers to CSR array
+    Precision precision_; // storage precision of values
+    unsigned short* hs_; // values when stored in 16 bit, in which case vs_ and mat_ are unused
+    bool isDense_; // true if all m_ x n_ values are stored row-major, in which case js_ and mat_ are unused
     sparse_matrix_t mat_; // opaque MKL sparse matrix object
     bool isSorted_; // true if we definately know the sparse matrix is sorted
     bool isOwned_; // true if data arrays owned by this object (false is owned by MKL or by a parent matrix)
@@ -108,20 +149,31 @@ protected:
     sparse_status_t status_; // last MKL function status
 
     friend MatrixSparseView;
+    friend MatrixSparseBatch;
     friend std::ostream& operator<<(std::ostream& os, const MatrixSparse& a);
 };
 
 std::ostream& operator<<(std::ostream& os, const MatrixSparse& a);
 
 
+#include "MatrixSparse.tpp"
+
+
+// zero-copy view of rows of a matrix, which must outlive it. Only the row offsets are held here, and an MKL handle is
+// only created if an MKL routine is called on the view
 class MatrixSparseView : public MatrixSparse
 {
 public:
-    MatrixSparseView(const MatrixSparse &a, ii row);
-    ~MatrixSparseView();
+    MatrixSparseView(const MatrixSparse &a, ii row); // row vector a[row,]
+    MatrixSparseView(const MatrixSparse &a, ii row, ii m); // a[row:(row + m),]
+    MatrixSparseView(const MatrixSparseView&) = delete;
+    MatrixSparseView& operator=(const MatrixSparseView&) = delete;
 
 private:
-    bool isOwned_;
+    void view(const MatrixSparse &a, ii row, ii* is);
+
+    ii is_[2]; // row offsets of a single row view
+    std::vector<ii> iss_; // row offsets of a multiple row view
 };
 
 
@@ -0,0 +1,115 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef SEAMASS_KERNEL_INTEL_MATRIXSPARSE_TPP
+#define SEAMASS_KERNEL_INTEL_MATRIXSPARSE_TPP
+
+
+#include "MatrixSparse.hpp"
+#include <cassert>
+#include <sstream>
+#include <string>
+
+
+namespace kernel
+{
+    // declared in kernel.hpp, which includes this file
+    std::string getTimeStamp();
+    void checkIndex(li size, const std::string& what);
+}
+
+
+template<typename CountRow, typename FillRow>
+void MatrixSparse::copyRows(ii m, ii n, CountRow countRow, FillRow fillRow, bool sorted)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        std::ostringstream oss;
+        oss << kernel::getTimeStamp() << "       copyRows([" << m << "," << n << "]) := ...";
+        info(oss.str());
+    }
+
+    init(m, n);
+
+    if (m > 0)
+    {
+        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+        is0_[0] = 0;
+        is1_ = is0_ + 1;
+
+        // first pass counts the non-zeros of each row
+        #pragma omp parallel for
+        for (ii i = 0; i < m; i++)
+            is1_[i] = countRow(i);
+
+        // total the counts before the prefix sum can overflow
+        li nnz = 0;
+        for (ii i = 0; i < m; i++)
+            nnz += is1_[i];
+
+        try
+        {
+            kernel::checkIndex(nnz, "copyRows");
+        }
+        catch (...)
+        {
+            mkl_free(is0_);
+            is1_ = 0;
+            throw;
+        }
+
+        for (ii i = 0; i < m; i++)
+            is1_[i] += is0_[i];
+
+        if (is1_[m - 1] > 0)
+        {
+            // second pass fills each row in place
+            js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1_[m - 1], 64));
+            vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1_[m - 1], 64));
+
+            #pragma omp parallel for
+            for (ii i = 0; i < m; i++)
+                fillRow(i, &js_[is0_[i]], &vs_[is0_[i]]);
+
+            status_ = mkl_sparse_s_create_csr(&mat_, SPARSE_INDEX_BASE_ZERO, m_, n_, is0_, is1_, js_, vs_);
+            assert(!status_);
+
+            isOwned_ = true;
+            isSorted_ = sorted;
+        }
+        else
+        {
+            mkl_free(is0_);
+            is1_ = 0;
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        std::ostringstream oss;
+        oss << kernel::getTimeStamp() << "       ... X" << *this;
+        info(oss.str(), this);
+    }
+}
+
+
+#endif
@@ -0,0 +1,1320 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#include "MatrixSparseBatch.hpp"
+#include "kernel.hpp"
+#include <iomanip>
+#include <sstream>
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <ippcore.h>
+#include <ipps.h>
+#if defined(_OPENMP)
+  #include <omp.h>
+#endif
+using namespace std;
+using namespace kernel;
+
+
+MatrixSparseBatch::MatrixSparseBatch() : is0_(0), is1_(0), js_(0), vs_(0), rs_(0), runs_(0), ds_(0), dvs_(0), isSorted_(true), maxRowNnz_(0)
+{
+}
+
+
+MatrixSparseBatch::~MatrixSparseBatch()
+{
+    free();
+}
+
+
+void MatrixSparseBatch::init()
+{
+    free();
+
+    blockRows_.assign(1, 0);
+    ns_.clear();
+}
+
+
+void MatrixSparseBatch::free()
+{
+    if (is0_)
+    {
+        mkl_free(is0_);
+        if (rs_)
+        {
+            mkl_free(rs_);
+            mkl_free(runs_);
+        }
+        else
+        {
+            mkl_free(js_);
+        }
+        if (ds_)
+        {
+            mkl_free(ds_);
+            mkl_free(dvs_);
+        }
+        else
+        {
+            mkl_free(vs_);
+        }
+
+        is0_ = 0;
+        is1_ = 0;
+        js_ = 0;
+        vs_ = 0;
+        rs_ = 0;
+        runs_ = 0;
+        ds_ = 0;
+        dvs_ = 0;
+    }
+
+    fillRow_ = nullptr;
+    maxRowNnz_ = 0;
+    columnCounts_.clear();
+    columns_.clear();
+}
+
+
+void MatrixSparseBatch::swap(MatrixSparseBatch& a)
+{
+    std::swap(blockRows_, a.blockRows_);
+    std::swap(ns_, a.ns_);
+    std::swap(is0_, a.is0_);
+    std::swap(is1_, a.is1_);
+    std::swap(js_, a.js_);
+    std::swap(vs_, a.vs_);
+    std::swap(rs_, a.rs_);
+    std::swap(runs_, a.runs_);
+    std::swap(ds_, a.ds_);
+    std::swap(dvs_, a.dvs_);
+    std::swap(isSorted_, a.isSorted_);
+    std::swap(fillRow_, a.fillRow_);
+    std::swap(maxRowNnz_, a.maxRowNnz_);
+    std::swap(columnCounts_, a.columnCounts_);
+    std::swap(columns_, a.columns_);
+}
+
+
+const fp* MatrixSparseBatch::values(ii row) const
+{
+    return ds_ ? &dvs_[ds_[row]] - is0_[row] : vs_;
+}
+
+
+template<typename Function>
+void MatrixSparseBatch::forRow(ii row, Function f) const
+{
+    if (fillRow_)
+    {
+        // generate the row into per-thread scratch, nz is then its position in the scratch
+        static thread_local vector<ii> js;
+        static thread_local vector<fp> vs;
+        if ((ii)js.size() < maxRowNnz_)
+        {
+            js.resize(maxRowNnz_);
+            vs.resize(maxRowNnz_);
+        }
+
+        ii k = ii(upper_bound(blockRows_.begin(), blockRows_.end(), row) - blockRows_.begin()) - 1;
+        ii nnz = fillRow_(k, row - blockRows_[k], js.data(), vs.data());
+        assert(nnz <= maxRowNnz_);
+
+        const vector<ii>& cs = columns_[k];
+        if (cs.empty())
+        {
+            for (ii nz = 0; nz < nnz; nz++)
+                f(nz, js[nz], vs[nz]);
+        }
+        else if (nnz > 0)
+        {
+            // both the row and the remaining columns are sorted, so walk them together to skip pruned columns
+            vector<ii>::const_iterator c = lower_bound(cs.begin(), cs.end(), js[0]);
+            for (ii nz = 0; nz < nnz && c != cs.end(); nz++)
+            {
+                while (c != cs.end() && *c < js[nz])
+                    c++;
+                if (c != cs.end() && *c == js[nz])
+                    f(nz, js[nz], vs[nz]);
+            }
+        }
+
+        return;
+    }
+
+    if (!columns_.empty())
+    {
+        ii k = ii(upper_bound(blockRows_.begin(), blockRows_.end(), row) - blockRows_.begin()) - 1;
+        const vector<ii>& cs = columns_[k];
+
+        if (!cs.empty())
+        {
+            // as above, walk the sorted row and the sorted unmasked columns together
+            vector<ii>::const_iterator c = cs.begin();
+            bool first = true;
+            forStoredRow(row, [&](ii nz, ii j, fp v)
+            {
+                if (first)
+                {
+                    c = lower_bound(cs.begin(), cs.end(), j);
+                    first = false;
+                }
+
+                while (c != cs.end() && *c < j)
+                    c++;
+                if (c != cs.end() && *c == j)
+                    f(nz, j, v);
+            });
+
+            return;
+        }
+    }
+
+    forStoredRow(row, f);
+}
+
+
+template<typename Function>
+void MatrixSparseBatch::forStoredRow(ii row, Function f) const
+{
+    const fp* vs = values(row);
+
+    if (rs_)
+    {
+        ii nz = is0_[row];
+        for (ii r = rs_[row]; r < rs_[row + 1]; r++)
+        {
+            ii j = runs_[2 * r];
+            for (ii end = nz + runs_[2 * r + 1]; nz < end; nz++, j++)
+                f(nz, j, vs[nz]);
+        }
+    }
+    else
+    {
+        for (ii nz = is0_[row]; nz < is1_[row]; nz++)
+            f(nz, js_[nz], vs[nz]);
+    }
+}
+
+
+ii MatrixSparseBatch::count() const
+{
+    return ii(ns_.size());
+}
+
+
+ii MatrixSparseBatch::m(ii k) const
+{
+    return blockRows_[k + 1] - blockRows_[k];
+}
+
+
+ii MatrixSparseBatch::n(ii k) const
+{
+    return ns_[k];
+}
+
+
+ii MatrixSparseBatch::blockRows(ii k) const
+{
+    return blockRows_[k];
+}
+
+
+li MatrixSparseBatch::size() const
+{
+    li size = 0;
+    for (ii k = 0; k < count(); k++)
+        size += li(m(k)) * n(k);
+
+    return size;
+}
+
+
+ii MatrixSparseBatch::nnz() const
+{
+    if (is1_ && blockRows_.back() > 0)
+        return is1_[blockRows_.back() - 1];
+    else
+        return 0;
+}
+
+
+ii MatrixSparseBatch::nnz(ii k) const
+{
+    if (is1_)
+        return is0_[blockRows_[k + 1]] - is0_[blockRows_[k]];
+    else
+        return 0;
+}
+
+
+bool MatrixSparseBatch::isCompressed() const
+{
+    return rs_ || ds_;
+}
+
+
+bool MatrixSparseBatch::isImplicit() const
+{
+    return bool(fillRow_);
+}
+
+
+void MatrixSparseBatch::compress()
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       compress(X" << *this << ") := ...";
+        info(oss.str());
+    }
+
+    if (is0_ && !rs_)
+    {
+        // count the runs of consecutive columns in each row
+        ii m = blockRows_.back();
+        ii* rs = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+        #pragma omp parallel for
+        for (ii i = 0; i < m; i++)
+        {
+            rs[i] = is1_[i] > is0_[i] ? 1 : 0;
+            for (ii nz = is0_[i] + 1; nz < is1_[i]; nz++)
+            {
+                if (js_[nz] != js_[nz - 1] + 1)
+                    rs[i]++;
+            }
+        }
+        rs[m] = 0;
+        ii runs = prefixSum(rs, m + 1);
+
+        if (2 * li(runs) + m + 1 < nnz())
+        {
+            runs_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * 2 * runs, 64));
+            #pragma omp parallel for
+            for (ii i = 0; i < m; i++)
+            {
+                ii r = rs[i] - 1;
+                for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+                {
+                    if (nz == is0_[i] || js_[nz] != js_[nz - 1] + 1)
+                    {
+                        r++;
+                        runs_[2 * r] = js_[nz];
+                        runs_[2 * r + 1] = 0;
+                    }
+                    runs_[2 * r + 1]++;
+                }
+            }
+
+            mkl_free(js_);
+            js_ = 0;
+            rs_ = rs;
+        }
+        else
+        {
+            mkl_free(rs);
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        if (rs_) oss << " (" << rs_[blockRows_.back()] << " runs)";
+        info(oss.str());
+    }
+}
+
+
+void MatrixSparseBatch::compressValues()
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       compressValues(X" << *this << ") := ...";
+        info(oss.str());
+    }
+
+    if (is0_ && !ds_)
+    {
+        // find the first row with identical values to each row, bucketed by a hash of the values
+        ii m = blockRows_.back();
+        vector<ii> firsts(m);
+        unordered_map<size_t, vector<ii> > buckets;
+        li length = 0;
+        for (ii i = 0; i < m; i++)
+        {
+            size_t hash = is1_[i] - is0_[i];
+            for (ii nz = is0_[i]; nz < is1_[i]; nz++)
+            {
+                unsigned int u;
+                memcpy(&u, &vs_[nz], sizeof(u));
+                hash = hash * 31 + u;
+            }
+
+            firsts[i] = i;
+            vector<ii>& bucket = buckets[hash];
+            for (size_t b = 0; b < bucket.size(); b++)
+            {
+                ii first = bucket[b];
+                if (is1_[first] - is0_[first] == is1_[i] - is0_[i] &&
+                    memcmp(&vs_[is0_[first]], &vs_[is0_[i]], sizeof(fp) * (is1_[i] - is0_[i])) == 0)
+                {
+                    firsts[i] = first;
+                    break;
+                }
+            }
+
+            if (firsts[i] == i)
+            {
+                bucket.push_back(i);
+                length += is1_[i] - is0_[i];
+            }
+        }
+
+        if (length + m < nnz())
+        {
+            ds_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * m, 64));
+            dvs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * length, 64));
+
+            ii offset = 0;
+            for (ii i = 0; i < m; i++)
+            {
+                if (firsts[i] == i)
+                {
+                    ds_[i] = offset;
+                    copyValues(&vs_[is0_[i]], &dvs_[offset], is1_[i] - is0_[i]);
+                    offset += is1_[i] - is0_[i];
+                }
+                else
+                {
+                    ds_[i] = ds_[firsts[i]];
+                }
+            }
+
+            mkl_free(vs_);
+            vs_ = 0;
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        if (ds_) oss << " (values in dictionary)";
+        info(oss.str());
+    }
+}
+
+
+void MatrixSparseBatch::copy(const vector<MatrixSparse>& as)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       copyBatch(A x " << as.size() << ") := ...";
+        info(oss.str());
+    }
+
+    init();
+
+    ii count = ii(as.size());
+    ns_.resize(count);
+    blockRows_.resize(count + 1);
+    li rows = 0;
+    for (ii k = 0; k < count; k++)
+    {
+        rows += as[k].m_;
+        blockRows_[k + 1] = blockRows_[k] + as[k].m_;
+        ns_[k] = as[k].n_;
+    }
+    checkIndex(rows, "copy");
+
+    li nnzTotal = 0;
+    for (ii k = 0; k < count; k++)
+        nnzTotal += as[k].nnz();
+    checkIndex(nnzTotal, "copy");
+
+    ii m = blockRows_.back();
+    is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+    is0_[0] = 0;
+    is1_ = is0_ + 1;
+    for (ii k = 0; k < count; k++)
+    {
+        for (ii i = 0; i < as[k].m_; i++)
+            is1_[blockRows_[k] + i] = is0_[blockRows_[k] + i] + (as[k].is1_ ? as[k].is1_[i] - as[k].is0_[i] : 0);
+    }
+
+    js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * nnz(), 64));
+    vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * nnz(), 64));
+    #pragma omp parallel for
+    for (ii k = 0; k < count; k++)
+    {
+        if (as[k].is1_)
+        {
+            assert(!as[k].isDense_);
+            copyIndices(&as[k].js_[as[k].is0_[0]], &js_[is0_[blockRows_[k]]], nnz(k));
+            copyValues(&as[k].vs_[as[k].is0_[0]], &vs_[is0_[blockRows_[k]]], nnz(k));
+        }
+    }
+
+    isSorted_ = true;
+    for (ii k = 0; k < count; k++)
+    {
+        if (!as[k].isSorted_)
+        {
+            isSorted_ = false;
+            break;
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str());
+    }
+}
+
+
+void MatrixSparseBatch::copy(const MatrixSparseBatch& a, bool transpose)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       " << (transpose ? "t(" : "") << "A" << a << (transpose ? ")" : "") << " := ...";
+        info(oss.str());
+    }
+
+    assert(!a.fillRow_);
+
+    init();
+
+    ii count = a.count();
+    ns_.resize(count);
+    blockRows_.resize(count + 1);
+    for (ii k = 0; k < count; k++)
+    {
+        ns_[k] = transpose ? a.m(k) : a.n(k);
+        blockRows_[k + 1] = blockRows_[k] + (transpose ? a.n(k) : a.m(k));
+    }
+
+    if (a.is0_)
+    {
+        ii m = blockRows_.back();
+        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+        is1_ = is0_ + 1;
+        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * a.nnz(), 64));
+
+        if (transpose)
+        {
+            js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * a.nnz(), 64));
+
+            // count non-zeros in each column of each block
+            for (ii i = 0; i <= m; i++)
+                is0_[i] = 0;
+
+            #pragma omp parallel for
+            for (ii k = 0; k < count; k++)
+            {
+                for (ii row = a.blockRows_[k]; row < a.blockRows_[k + 1]; row++)
+                {
+                    a.forRow(row, [&](ii a_nz, ii j, fp v)
+                    {
+                        is1_[blockRows_[k] + j]++;
+                    });
+                }
+            }
+
+            for (ii i = 0; i < m; i++)
+                is1_[i] += is0_[i];
+
+            // scatter in row order so that each output row is sorted
+            #pragma omp parallel
+            {
+                vector<ii> nzs;
+
+                #pragma omp for
+                for (ii k = 0; k < count; k++)
+                {
+                    nzs.assign(&is0_[blockRows_[k]], &is0_[blockRows_[k + 1]]);
+
+                    for (ii i = 0; i < a.m(k); i++)
+                    {
+                        a.forRow(a.blockRows_[k] + i, [&](ii a_nz, ii j, fp v)
+                        {
+                            ii nz = nzs[j]++;
+                            js_[nz] = i;
+                            vs_[nz] = v;
+                        });
+                    }
+                }
+            }
+
+            isSorted_ = true;
+        }
+        else
+        {
+            copyIndices(a.is0_, is0_, m + 1);
+            if (a.rs_)
+            {
+                rs_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+                runs_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * 2 * a.rs_[m], 64));
+                copyIndices(a.rs_, rs_, m + 1);
+                copyIndices(a.runs_, runs_, 2 * a.rs_[m]);
+            }
+            else
+            {
+                js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * a.nnz(), 64));
+                copyIndices(a.js_, js_, a.nnz());
+            }
+            if (a.ds_)
+            {
+                #pragma omp parallel for
+                for (ii i = 0; i < m; i++)
+                    copyValues(&a.values(i)[is0_[i]], &vs_[is0_[i]], is1_[i] - is0_[i]);
+            }
+            else
+            {
+                copyValues(a.vs_, vs_, a.nnz());
+            }
+
+            isSorted_ = a.isSorted_;
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str());
+    }
+}
+
+
+ii MatrixSparseBatch::copyPruneRows(const MatrixSparseBatch& a, const MatrixSparse& b, fp threshold)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       copyPruneRows(" << a << ",columns(" << b << ")) where nColumns to prune > ";
+        oss << fixed << setprecision(1) << threshold * 100.0 << "% := ...";
+        info(oss.str());
+    }
+
+    assert(!a.fillRow_);
+
+    init();
+
+    vector<ii> lengths;
+    ii rowsPruned = a.pruneRowsLengths(b, threshold, lengths);
+    if (rowsPruned > 0)
+    {
+        ii m = a.blockRows_.back();
+        blockRows_ = a.blockRows_;
+        ns_ = a.ns_;
+
+        is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+        is0_[0] = 0;
+        is1_ = is0_ + 1;
+        for (ii i = 0; i < m; i++)
+            is1_[i] = is0_[i] + lengths[i];
+
+        js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * nnz(), 64));
+        vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * nnz(), 64));
+        #pragma omp parallel for
+        for (ii i = 0; i < m; i++)
+        {
+            if (lengths[i] > 0)
+            {
+                ii offset = is0_[i] - a.is0_[i];
+                a.forRow(i, [&](ii a_nz, ii j, fp v)
+                {
+                    js_[offset + a_nz] = j;
+                    vs_[offset + a_nz] = v;
+                });
+            }
+        }
+
+        isSorted_ = a.isSorted_;
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this << " (" << rowsPruned << " rows pruned)";
+        info(oss.str());
+    }
+
+    return rowsPruned;
+}
+
+
+ii MatrixSparseBatch::pruneRows(const MatrixSparse& b, fp threshold)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       pruneRows(X" << *this << ",columns(" << b << ")) where nColumns to prune > ";
+        oss << fixed << setprecision(1) << threshold * 100.0 << "% := ...";
+        info(oss.str());
+    }
+
+    assert(!fillRow_);
+
+    vector<ii> lengths;
+    ii rowsPruned = pruneRowsLengths(b, threshold, lengths);
+    if (rowsPruned > 0 && rs_)
+    {
+        // pruned rows are dropped whole, so the runs of the remaining rows just move down with them
+        ii m = blockRows_.back();
+        vector<ii> runLengths(m + 1);
+        for (ii i = 0; i < m; i++)
+            runLengths[i] = lengths[i] > 0 ? rs_[i + 1] - rs_[i] : 0;
+        runLengths[m] = 0;
+        prefixSum(runLengths.data(), m + 1);
+
+        for (ii i = 0; i < m; i++)
+        {
+            ii length = runLengths[i + 1] - runLengths[i];
+            if (length > 0 && runLengths[i] != rs_[i])
+                memmove(&runs_[2 * runLengths[i]], &runs_[2 * rs_[i]], sizeof(ii) * 2 * length);
+        }
+        copyIndices(runLengths.data(), rs_, m + 1);
+    }
+
+    // compressed columns and values are not stored per non-zero (js_ or vs_ is 0), so are left where they are
+    if (rowsPruned > 0)
+        compactRows(blockRows_.back(), is0_, js_, vs_, lengths.data());
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this << " (" << rowsPruned << " rows pruned)";
+        info(oss.str());
+    }
+
+    return rowsPruned;
+}
+
+
+ii MatrixSparseBatch::pruneRowsLengths(const MatrixSparse& b, fp threshold, vector<ii>& lengths) const
+{
+    assert(count() == b.m_);
+
+    ii rowsPruned = 0;
+    if (is0_ && b.is1_)
+    {
+        ii count = this->count();
+        ii m = blockRows_.back();
+        lengths.resize(m + 1);
+        vector<ii> blockRowsPruned(count, 0);
+
+        // decide which blocks to prune and their new row lengths
+        #pragma omp parallel
+        {
+            vector<char> used;
+
+            #pragma omp for
+            for (ii k = 0; k < count; k++)
+            {
+                assert(this->m(k) <= b.n_);
+
+                ii aNnzRows = 0;
+                for (ii i = blockRows_[k]; i < blockRows_[k + 1]; i++)
+                {
+                    lengths[i] = is1_[i] - is0_[i];
+                    if (lengths[i] > 0)
+                        aNnzRows++;
+                }
+
+                used.assign(this->m(k), 0);
+                for (ii b_nz = b.is0_[k]; b_nz < b.is1_[k]; b_nz++)
+                    used[b.isDense_ ? b_nz - b.is0_[k] : b.js_[b_nz]] = 1;
+
+                ii bNnzCols = 0;
+                for (ii j = 0; j < this->m(k); j++)
+                    bNnzCols += used[j];
+
+                // as with MatrixSparse::copyPruneRows, nothing is pruned if the row of b is empty
+                if (aNnzRows > 0 && bNnzCols > 0 && bNnzCols / (fp) aNnzRows < threshold)
+                {
+                    for (ii j = 0; j < this->m(k); j++)
+                    {
+                        if (!used[j])
+                            lengths[blockRows_[k] + j] = 0;
+                    }
+
+                    blockRowsPruned[k] = aNnzRows - bNnzCols;
+                }
+            }
+        }
+
+        for (ii k = 0; k < count; k++)
+            rowsPruned += blockRowsPruned[k];
+    }
+
+    return rowsPruned;
+}
+
+
+ii MatrixSparseBatch::pruneColumns(const MatrixSparse& b, fp threshold)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       pruneColumns(X" << *this << ",columns(" << b << ")) where nColumns to prune > ";
+        oss << fixed << setprecision(1) << threshold * 100.0 << "% := ...";
+        info(oss.str());
+    }
+
+    assert(fillRow_);
+    assert(count() == b.m_);
+
+    ii columnsPruned = 0;
+    if (b.is1_)
+    {
+        ii count = this->count();
+        vector<ii> blockColumnsPruned(count, 0);
+
+        // same decision as pruneRowsLengths makes for the explicit transpose
+        #pragma omp parallel
+        {
+            vector<char> used;
+            vector<ii> js(maxRowNnz_);
+            vector<fp> vs(maxRowNnz_);
+
+            #pragma omp for
+            for (ii k = 0; k < count; k++)
+            {
+                assert(n(k) <= b.n_);
+
+                used.assign(n(k), 0);
+                for (ii b_nz = b.is0_[k]; b_nz < b.is1_[k]; b_nz++)
+                    used[b.isDense_ ? b_nz - b.is0_[k] : b.js_[b_nz]] = 1;
+
+                ii bNnzCols = 0;
+                for (ii j = 0; j < n(k); j++)
+                    bNnzCols += used[j];
+
+                if (columnCounts_[k] > 0 && bNnzCols > 0 && bNnzCols / (fp) columnCounts_[k] < threshold)
+                {
+                    // the remaining columns are those used by b that are not already empty
+                    vector<ii>& cs = columns_[k];
+                    if (cs.empty())
+                    {
+                        vector<char> nonEmpty(n(k), 0);
+                        for (ii i = 0; i < m(k); i++)
+                        {
+                            ii nnz = fillRow_(k, i, js.data(), vs.data());
+                            for (ii nz = 0; nz < nnz; nz++)
+                                nonEmpty[js[nz]] = 1;
+                        }
+
+                        for (ii j = 0; j < n(k); j++)
+                        {
+                            if (used[j] && nonEmpty[j])
+                                cs.push_back(j);
+                        }
+                    }
+                    else
+                    {
+                        ii length = 0;
+                        for (size_t c = 0; c < cs.size(); c++)
+                        {
+                            if (cs[c] < n(k) && used[cs[c]])
+                                cs[length++] = cs[c];
+                        }
+                        cs.resize(length);
+                    }
+
+                    blockColumnsPruned[k] = columnCounts_[k] - bNnzCols;
+                    columnCounts_[k] = ii(cs.size());
+
+                    // a block with every column pruned keeps one past the end, so that it is not mistaken for unpruned
+                    if (cs.empty())
+                        cs.push_back(n(k));
+                }
+            }
+        }
+
+        for (ii k = 0; k < count; k++)
+            columnsPruned += blockColumnsPruned[k];
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this << " (" << columnsPruned << " columns pruned)";
+        info(oss.str());
+    }
+
+    return columnsPruned;
+}
+
+
+void MatrixSparseBatch::maskColumns(const MatrixSparseBatch& aT, fp threshold)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       maskColumns(X" << *this << ",rows(" << aT << ")) where nnz to mask > ";
+        oss << fixed << setprecision(1) << threshold * 100.0 << "% := ...";
+        info(oss.str());
+    }
+
+    assert(!fillRow_ && !aT.fillRow_);
+    assert(count() == aT.count());
+
+    if (is0_)
+    {
+        if (!aT.is0_ || aT.nnz() < threshold * nnz() || !(isSorted_ || rs_))
+        {
+            // rebuild, as the transpose has no masked columns
+            bool compressed = rs_ != 0;
+            bool valuesCompressed = ds_ != 0;
+
+            copy(aT, true);
+            if (compressed)
+                compress();
+            if (valuesCompressed)
+                compressValues();
+        }
+        else
+        {
+            ii count = this->count();
+            columns_.resize(count);
+
+            #pragma omp parallel for
+            for (ii k = 0; k < count; k++)
+            {
+                assert(aT.m(k) == n(k));
+
+                vector<ii>& cs = columns_[k];
+                cs.clear();
+                for (ii j = 0; j < n(k); j++)
+                {
+                    ii row = aT.blockRows_[k] + j;
+                    if (aT.is1_[row] - aT.is0_[row] > 0)
+                        cs.push_back(j);
+                }
+
+                // no mask if nothing is masked, and as with pruneColumns a block with every column masked keeps one
+                // past the end
+                if (ii(cs.size()) == n(k))
+                    cs.clear();
+                else if (cs.empty())
+                    cs.push_back(n(k));
+            }
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... X" << *this;
+        info(oss.str());
+    }
+}
+
+
+void MatrixSparseBatch::matmulRows(vector<MatrixSparse>& ys, const MatrixSparse& x, bool accumulate, bool transposeA) const
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       rows(X" << x << ") %*% " << (transposeA ? "t(A" : "A") << *this << (transposeA ? ")" : "");
+        if (accumulate) oss << " + Y";
+        oss << " := ...";
+        info(oss.str());
+    }
+
+    assert(x.m_ == count());
+    assert(ys.size() == ns_.size());
+
+    #pragma omp parallel
+    {
+        vector<fp> xs; // dense row of x when transposed
+
+        #pragma omp for
+        for (ii k = 0; k < count(); k++)
+        {
+            MatrixSparse& y = ys[k];
+            ii n = transposeA ? m(k) : ns_[k];
+
+            if (!(accumulate && y.is1_ && y.isDense_ && y.m_ == 1 && y.n_ == n))
+            {
+                // (re)allocate a dense 1 x n output, carrying over any existing values if accumulating
+                MatrixSparse t;
+                t.initDense(1, n);
+                for (ii j = 0; j < n; j++)
+                    t.vs_[j] = 0.0;
+
+                if (accumulate && y.is1_)
+                {
+                    for (ii nz = y.is0_[0]; nz < y.is1_[y.m_ - 1]; nz++)
+                        t.vs_[y.isDense_ ? nz : y.js_[nz]] += y.vs_[nz];
+                }
+
+                y.swap(t);
+            }
+
+            if (!(is0_ || fillRow_) || !x.is1_)
+                continue;
+
+            fp* vs = y.vs_;
+            if (transposeA)
+            {
+                // scatter the row of x so that each row of A can gather from it
+                xs.resize(ns_[k], 0.0);
+                for (ii x_nz = x.is0_[k]; x_nz < x.is1_[k]; x_nz++)
+                    xs[x.isDense_ ? x_nz - x.is0_[k] : x.js_[x_nz]] = x.vs_[x_nz];
+
+                for (ii i = 0; i < n; i++)
+                {
+                    fp v = vs[i];
+                    forRow(blockRows_[k] + i, [&](ii nz, ii j, fp a)
+                    {
+                        v += xs[j] * a;
+                    });
+                    vs[i] = v;
+                }
+
+                for (ii x_nz = x.is0_[k]; x_nz < x.is1_[k]; x_nz++)
+                    xs[x.isDense_ ? x_nz - x.is0_[k] : x.js_[x_nz]] = 0.0;
+            }
+            else
+            {
+                for (ii x_nz = x.is0_[k]; x_nz < x.is1_[k]; x_nz++)
+                {
+                    ii row = blockRows_[k] + (x.isDense_ ? x_nz - x.is0_[k] : x.js_[x_nz]);
+                    fp v = x.vs_[x_nz];
+
+                    if (rs_)
+                    {
+                        // each run is a contiguous axpy with no index stream
+                        const fp* as = values(row);
+                        ii nz = is0_[row];
+                        for (ii r = rs_[row]; r < rs_[row + 1]; r++)
+                        {
+                            fp* ys = &vs[runs_[2 * r]] - nz;
+                            for (ii end = nz + runs_[2 * r + 1]; nz < end; nz++)
+                                ys[nz] += v * as[nz];
+                        }
+                    }
+                    else
+                    {
+                        forRow(row, [&](ii nz, ii j, fp a)
+                        {
+                            vs[j] += v * a;
+                        });
+                    }
+                }
+            }
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... Y x " << ys.size() << " (DENSE)";
+        info(oss.str());
+    }
+}
+
+
+void MatrixSparseBatch::matmulRows(MatrixSparse& y, const vector<MatrixSparse>& xs, bool sqrA) const
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       X x " << xs.size() << " %*% ";
+        oss << (sqrA ? "sqr(A" : "A") << *this << (sqrA ? ")" : "") << " := ...";
+        info(oss.str());
+    }
+
+    assert(xs.size() == ns_.size());
+
+    ii count = this->count();
+    ii n = 0;
+    for (ii k = 0; k < count; k++)
+        n = ns_[k] > n ? ns_[k] : n;
+
+    y.init(count, n);
+
+    if ((is0_ || fillRow_) && count > 0)
+    {
+        ii* is0 = static_cast<ii*>(mkl_malloc(sizeof(ii) * (count + 1), 64));
+        is0[0] = 0;
+        ii* is1 = is0 + 1;
+
+        // first pass counts the distinct columns touched in each output row
+        #pragma omp parallel
+        {
+            vector<char> touched(n, 0);
+            vector<ii> cols;
+
+            #pragma omp for
+            for (ii k = 0; k < count; k++)
+            {
+                cols.clear();
+                if (xs[k].is1_)
+                {
+                    for (ii x_nz = 0; x_nz < xs[k].nnz(); x_nz++)
+                    {
+                        ii row = blockRows_[k] + (xs[k].isDense_ ? x_nz : xs[k].js_[x_nz]);
+                        forRow(row, [&](ii nz, ii j, fp a)
+                        {
+                            if (!touched[j])
+                            {
+                                touched[j] = 1;
+                                cols.push_back(j);
+                            }
+                        });
+                    }
+                }
+
+                is1[k] = ii(cols.size());
+                for (size_t c = 0; c < cols.size(); c++)
+                    touched[cols[c]] = 0;
+            }
+        }
+
+        // total the counts before the prefix sum can overflow
+        li nnzTotal = 0;
+        for (ii k = 0; k < count; k++)
+            nnzTotal += is1[k];
+
+        try
+        {
+            checkIndex(nnzTotal, "matmulRows");
+        }
+        catch (...)
+        {
+            mkl_free(is0);
+            throw;
+        }
+
+        for (ii k = 0; k < count; k++)
+            is1[k] += is0[k];
+
+        if (is1[count - 1] > 0)
+        {
+            ii* js = static_cast<ii*>(mkl_malloc(sizeof(ii) * is1[count - 1], 64));
+            fp* vs = static_cast<fp*>(mkl_malloc(sizeof(fp) * is1[count - 1], 64));
+
+            // second pass accumulates into a dense row and gathers it back out in column order
+            #pragma omp parallel
+            {
+                vector<fp> acc(n, 0.0);
+                vector<char> touched(n, 0);
+
+                #pragma omp for
+                for (ii k = 0; k < count; k++)
+                {
+                    ii nnz = is0[k];
+                    if (xs[k].is1_)
+                    {
+                        for (ii x_nz = 0; x_nz < xs[k].nnz(); x_nz++)
+                        {
+                            ii row = blockRows_[k] + (xs[k].isDense_ ? x_nz : xs[k].js_[x_nz]);
+                            fp v = xs[k].vs_[x_nz];
+
+                            forRow(row, [&](ii nz, ii j, fp a)
+                            {
+                                if (!touched[j])
+                                {
+                                    touched[j] = 1;
+                                    js[nnz++] = j;
+                                }
+                                acc[j] += sqrA ? v * a * a : v * a;
+                            });
+                        }
+                    }
+
+                    std::sort(&js[is0[k]], &js[is1[k]]);
+                    for (ii nz = is0[k]; nz < is1[k]; nz++)
+                    {
+                        vs[nz] = acc[js[nz]];
+                        acc[js[nz]] = 0.0;
+                        touched[js[nz]] = 0;
+                    }
+                }
+            }
+
+            y.is0_ = is0;
+            y.is1_ = is1;
+            y.js_ = js;
+            y.vs_ = vs;
+
+            y.status_ = mkl_sparse_s_create_csr(&y.mat_, SPARSE_INDEX_BASE_ZERO, y.m_, y.n_, y.is0_, y.is1_, y.js_, y.vs_);
+            assert(!y.status_);
+
+            y.isOwned_ = true;
+            y.isSorted_ = true;
+        }
+        else
+        {
+            mkl_free(is0);
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... Y" << y;
+        info(oss.str());
+    }
+}
+
+
+void MatrixSparseBatch::sumColumns(MatrixSparse& y, MatrixSparse& ySqr) const
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       colSums(A" << *this << "), colSums(sqr(A" << *this << ")) := ...";
+        info(oss.str());
+    }
+
+    ii count = this->count();
+    ii n = 0;
+    for (ii k = 0; k < count; k++)
+        n = ns_[k] > n ? ns_[k] : n;
+
+    y.init(count, n);
+    ySqr.init(count, n);
+
+    if ((is0_ || fillRow_) && count > 0)
+    {
+        // each row is visited (or generated) once, accumulating both sums in the same order as matmulRows would
+        vector< vector<ii> > jss(count);
+        vector< vector<fp> > vss(count);
+        vector< vector<fp> > vsSqrs(count);
+
+        #pragma omp parallel
+        {
+            vector<fp> acc(n, 0.0);
+            vector<fp> accSqr(n, 0.0);
+            vector<char> touched(n, 0);
+
+            #pragma omp for
+            for (ii k = 0; k < count; k++)
+            {
+                vector<ii>& js = jss[k];
+                for (ii row = blockRows_[k]; row < blockRows_[k + 1]; row++)
+                {
+                    forRow(row, [&](ii nz, ii j, fp a)
+                    {
+                        if (!touched[j])
+                        {
+                            touched[j] = 1;
+                            js.push_back(j);
+                        }
+                        acc[j] += a;
+                        accSqr[j] += a * a;
+                    });
+                }
+
+                std::sort(js.begin(), js.end());
+                vss[k].resize(js.size());
+                vsSqrs[k].resize(js.size());
+                for (size_t nz = 0; nz < js.size(); nz++)
+                {
+                    vss[k][nz] = acc[js[nz]];
+                    vsSqrs[k][nz] = accSqr[js[nz]];
+                    acc[js[nz]] = 0.0;
+                    accSqr[js[nz]] = 0.0;
+                    touched[js[nz]] = 0;
+                }
+            }
+        }
+
+        li nnzTotal = 0;
+        for (ii k = 0; k < count; k++)
+            nnzTotal += li(jss[k].size());
+        checkIndex(nnzTotal, "sumColumns");
+
+        if (nnzTotal > 0)
+        {
+            for (MatrixSparse* out : { &y, &ySqr })
+            {
+                const vector< vector<fp> >& vs = out == &y ? vss : vsSqrs;
+
+                out->is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (count + 1), 64));
+                out->is1_ = out->is0_ + 1;
+                out->js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * nnzTotal, 64));
+                out->vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * nnzTotal, 64));
+
+                out->is0_[0] = 0;
+                for (ii k = 0; k < count; k++)
+                {
+                    out->is1_[k] = out->is0_[k] + ii(jss[k].size());
+                    std::copy(jss[k].begin(), jss[k].end(), &out->js_[out->is0_[k]]);
+                    std::copy(vs[k].begin(), vs[k].end(), &out->vs_[out->is0_[k]]);
+                }
+
+                out->status_ = mkl_sparse_s_create_csr(&out->mat_, SPARSE_INDEX_BASE_ZERO, out->m_, out->n_, out->is0_, out->is1_, out->js_, out->vs_);
+                assert(!out->status_);
+
+                out->isOwned_ = true;
+                out->isSorted_ = true;
+            }
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        ostringstream oss;
+        oss << getTimeStamp() << "       ... Y" << y << ", Y" << ySqr;
+        info(oss.str());
+    }
+}
+
+
+ostream& operator<<(ostream& os, const MatrixSparseBatch& a)
+{
+    if (a.count() == 0)
+    {
+        os << "{}";
+    }
+    else
+    {
+        os << "{" << a.count() << "}[" << a.blockRows_.back() << ",~]:";
+        if (a.fillRow_)
+        {
+            os << "IMPLICIT";
+        }
+        else
+        {
+            os << a.nnz() << "/" << a.size() << ":";
+            os.unsetf(ios::floatfield);
+            os << setprecision(3) << 100.0 * a.nnz() / (double)a.size() << "%";
+        }
+    }
+
+    return  os;
+}
@@ -0,0 +1,118 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef SEAMASS_KERNEL_INTEL_MATRIXSPARSEBATCH_HPP
+#define SEAMASS_KERNEL_INTEL_MATRIXSPARSEBATCH_HPP
+
+
+#include "MatrixSparse.hpp"
+#include <functional>
+
+
+/**
+* MatrixSparseBatch is a batch of independent sparse matrices (e.g. one per spectrum) stored as a single block-diagonal
+* CSR matrix. Each block k occupies rows [blockRows(k), blockRows(k+1)) and has its own local column indices in
+* [0, n(k)). The batched kernels process all blocks in one parallel launch and write straight into their outputs.
+*
+* B-spline basis matrices touch short runs of consecutive columns, so once built they can be compressed to store each
+* run as (first column, length) rather than an index per non-zero. With regularly spaced bins many rows also have
+* identical values, which can be stored once in a dictionary. Only functions marked (compressed) accept either.
+*
+* Where even that is too much memory, the matrix can instead be implicit: nothing is stored and each row is generated
+* on demand by a callback whenever it is needed, with columns pruned away recorded per block. Only functions marked
+* (implicit) accept it.
+*/
+class MatrixSparseBatch : public SubjectMatrixSparse
+{
+public:
+    MatrixSparseBatch();
+    ~MatrixSparseBatch();
+
+    typedef std::function<ii(ii k, ii i, ii* js, fp* vs)> RowGenerator; // writes row i of block k sorted, returns its nnz
+
+    void init();
+    void free();
+    void swap(MatrixSparseBatch& a);
+
+    // accessors
+    ii count() const;          // number of blocks
+    ii m(ii k) const;          // number of rows in block k
+    ii n(ii k) const;          // number of columns in block k
+    ii blockRows(ii k) const;  // first row of block k in the concatenated CSR
+    li size() const;           // sum of block sizes
+    ii nnz() const;
+    ii nnz(ii k) const;
+    bool isCompressed() const;
+    bool isImplicit() const;
+
+    void compress(); // store column indices as runs of consecutive columns, if that is smaller
+    void compressValues(); // store each distinct row of values once, if that is smaller
+
+    // these functions allocate memory
+    void copy(const std::vector<MatrixSparse>& as); // create from a vector of blocks
+    template<typename CountRow, typename FillRow>
+    void copyRows(const std::vector<ii>& ms, const std::vector<ii>& ns, CountRow countRow, FillRow fillRow, bool sorted = true); // create directly: countRow(k, i) returns the nnz of row i of block k, then fillRow(k, i, js, vs) writes it
+    template<typename CountRow>
+    void copyImplicit(const std::vector<ii>& ms, const std::vector<ii>& ns, CountRow countRow, RowGenerator fillRow); // create implicitly: as copyRows but fillRow(k, i, js, vs) is called each time a row is needed, so whatever it refers to must outlive us
+    void copy(const MatrixSparseBatch& a, bool transpose = false); // (compressed) a, blockwise transpose
+    ii copyPruneRows(const MatrixSparseBatch& a, const MatrixSparse& b, fp threshold); // (compressed) a, prune rows of block k when columns of row k of b are empty
+    ii pruneRows(const MatrixSparse& b, fp threshold); // (compressed) as copyPruneRows(*this, b, threshold), but compacting in place
+    ii pruneColumns(const MatrixSparse& b, fp threshold); // (implicit) as pruneRows on our transpose, i.e. prune columns of block k when columns of row k of b are empty
+    void maskColumns(const MatrixSparseBatch& aT, fp threshold); // (compressed) follow aT.pruneRows on our transpose aT by masking the columns that are now empty rows of aT, only rebuilding from aT once our stored nnz that remain unmasked falls below threshold
+
+    // batched operations
+    void matmulRows(std::vector<MatrixSparse>& ys, const MatrixSparse& x, bool accumulate, bool transposeA = false) const; // (compressed) (implicit) ys[k] = x[k,] %*% A[k] (or t(A[k])) with dense output
+    void matmulRows(MatrixSparse& y, const std::vector<MatrixSparse>& xs, bool sqrA) const; // (compressed) (implicit) y[k,] = xs[k] %*% A[k] (or sqr(A[k]))
+    void sumColumns(MatrixSparse& y, MatrixSparse& ySqr) const; // (compressed) (implicit) y[k,] = colSums(A[k]) and ySqr[k,] = colSums(sqr(A[k])), as matmulRows of all-ones xs but in one pass
+
+protected:
+    ii pruneRowsLengths(const MatrixSparse& b, fp threshold, std::vector<ii>& lengths) const; // if any rows can be pruned, returns how many and their new lengths
+    template<typename Function>
+    void forRow(ii row, Function f) const; // calls f(nz, j, v) for each non-zero of a row, decoding if compressed or generating if implicit, skipping masked columns
+    template<typename Function>
+    void forStoredRow(ii row, Function f) const; // as forRow for a row that is stored, but including masked columns
+    const fp* values(ii row) const; // p such that p[nz] are the values of a row, whether or not they are in a dictionary
+
+    std::vector<ii> blockRows_; // first row of each block, plus total rows
+    std::vector<ii> ns_;        // number of columns of each block
+
+    ii* is0_; ii* is1_; ii* js_; fp* vs_; // pointers to concatenated CSR arrays
+    ii* rs_; ii* runs_; // if compressed, first run of each row (plus total) and (first column, length) of each run, js_ is 0
+    ii* ds_; fp* dvs_; // if values are compressed, offset of each row's values in the dictionary dvs_, vs_ is 0
+    bool isSorted_; // true if we definately know each row is sorted
+
+    RowGenerator fillRow_; // if implicit, generates each row on demand and is0_ is 0
+    ii maxRowNnz_; // if implicit, largest nnz of any row
+    std::vector<ii> columnCounts_; // if implicit, number of non-empty columns of each block
+    std::vector< std::vector<ii> > columns_; // if implicit, sorted non-empty columns of each block once any have been pruned, if not, sorted unmasked columns once any have been masked
+
+    friend std::ostream& operator<<(std::ostream& os, const MatrixSparseBatch& a);
+};
+
+std::ostream& operator<<(std::ostream& os, const MatrixSparseBatch& a);
+
+
+#include "MatrixSparseBatch.tpp"
+
+
+#endif
+
@@ -0,0 +1,185 @@
+//
+// Original author: Andrew Dowsey <andrew.dowsey <a.t> bristol.ac.uk>
+//
+// Copyright (C) 2016  biospi Laboratory, University of Bristol, UK
+//
+// This file is part of seaMass.
+//
+// seaMass is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// seaMass is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with seaMass.  If not, see <http://www.gnu.org/licenses/>.
+//
+
+
+#ifndef SEAMASS_KERNEL_INTEL_MATRIXSPARSEBATCH_TPP
+#define SEAMASS_KERNEL_INTEL_MATRIXSPARSEBATCH_TPP
+
+
+#include "MatrixSparseBatch.hpp"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+
+template<typename CountRow, typename FillRow>
+void MatrixSparseBatch::copyRows(const std::vector<ii>& ms, const std::vector<ii>& ns, CountRow countRow, FillRow fillRow, bool sorted)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        std::ostringstream oss;
+        oss << kernel::getTimeStamp() << "       copyRows({" << ms.size() << "}) := ...";
+        info(oss.str());
+    }
+
+    assert(ms.size() == ns.size());
+
+    init();
+
+    ii count = ii(ms.size());
+    ns_ = ns;
+    blockRows_.resize(count + 1);
+    li rows = 0;
+    for (ii k = 0; k < count; k++)
+    {
+        rows += ms[k];
+        blockRows_[k + 1] = blockRows_[k] + ms[k];
+    }
+    kernel::checkIndex(rows, "copyRows");
+
+    ii m = blockRows_.back();
+    is0_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * (m + 1), 64));
+    is0_[0] = 0;
+    is1_ = is0_ + 1;
+
+    // first pass counts the non-zeros of each row, parallelised over all rows of all blocks
+    #pragma omp parallel for
+    for (ii i = 0; i < m; i++)
+    {
+        ii k = ii(std::upper_bound(blockRows_.begin(), blockRows_.end(), i) - blockRows_.begin()) - 1;
+        is1_[i] = countRow(k, i - blockRows_[k]);
+    }
+
+    // total the counts before the prefix sum can overflow
+    li nnz = 0;
+    for (ii i = 0; i < m; i++)
+        nnz += is1_[i];
+
+    try
+    {
+        kernel::checkIndex(nnz, "copyRows");
+    }
+    catch (...)
+    {
+        free();
+        throw;
+    }
+
+    for (ii i = 0; i < m; i++)
+        is1_[i] += is0_[i];
+
+    // second pass fills each row in place
+    js_ = static_cast<ii*>(mkl_malloc(sizeof(ii) * nnz, 64));
+    vs_ = static_cast<fp*>(mkl_malloc(sizeof(fp) * nnz, 64));
+
+    #pragma omp parallel for
+    for (ii i = 0; i < m; i++)
+    {
+        ii k = ii(std::upper_bound(blockRows_.begin(), blockRows_.end(), i) - blockRows_.begin()) - 1;
+        fillRow(k, i - blockRows_[k], &js_[is0_[i]], &vs_[is0_[i]]);
+    }
+
+    isSorted_ = sorted;
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        std::ostringstream oss;
+        oss << kernel::getTimeStamp() << "       ... X" << *this;
+        info(oss.str());
+    }
+}
+
+template<typename CountRow>
+void MatrixSparseBatch::copyImplicit(const std::vector<ii>& ms, const std::vector<ii>& ns, CountRow countRow, RowGenerator fillRow)
+{
+    if (getDebugLevel() % 10 >= 4)
+    {
+        std::ostringstream oss;
+        oss << kernel::getTimeStamp() << "       copyImplicit({" << ms.size() << "}) := ...";
+        info(oss.str());
+    }
+
+    assert(ms.size() == ns.size());
+
+    init();
+
+    ii count = ii(ms.size());
+    ns_ = ns;
+    blockRows_.resize(count + 1);
+    li rows = 0;
+    for (ii k = 0; k < count; k++)
+    {
+        rows += ms[k];
+        blockRows_[k + 1] = blockRows_[k] + ms[k];
+    }
+    kernel::checkIndex(rows, "copyImplicit");
+
+    fillRow_ = fillRow;
+    columnCounts_.resize(count);
+    columns_.assign(count, std::vector<ii>());
+
+    // the largest row sets the size of the scratch each thread generates rows into
+    std::vector<ii> maxRowNnzs(count, 0);
+    #pragma omp parallel for
+    for (ii k = 0; k < count; k++)
+    {
+        for (ii i = 0; i < ms[k]; i++)
+        {
+            ii nnz = countRow(k, i);
+            maxRowNnzs[k] = nnz > maxRowNnzs[k] ? nnz : maxRowNnzs[k];
+        }
+    }
+    maxRowNnz_ = count > 0 ? *std::max_element(maxRowNnzs.begin(), maxRowNnzs.end()) : 0;
+
+    // generate every row once to count the non-empty columns of each block, which pruneColumns needs
+    #pragma omp parallel
+    {
+        std::vector<ii> js(maxRowNnz_);
+        std::vector<fp> vs(maxRowNnz_);
+        std::vector<char> used;
+
+        #pragma omp for
+        for (ii k = 0; k < count; k++)
+        {
+            used.assign(ns_[k], 0);
+            for (ii i = 0; i < ms[k]; i++)
+            {
+                ii nnz = fillRow_(k, i, js.data(), vs.data());
+                for (ii nz = 0; nz < nnz; nz++)
+                    used[js[nz]] = 1;
+            }
+
+            columnCounts_[k] = 0;
+            for (ii j = 0; j < ns_[k]; j++)
+                columnCounts_[k] += used[j];
+        }
+    }
+
+    if (getDebugLevel() % 10 >= 4)
+    {
+        std::ostringstream oss;
+        oss << kernel::getTimeStamp() << "       ... X" << *this;
+        info(oss.str());
+    }
+}
+
+
+#endif
@@ -20,13 +20,21 @@
 //
 
 
-#include "MatrixSparse.hpp"
+#include "kernel.hpp"
 #include <iomanip>
 #include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <cstring>
 #if defined(_OPENMP)
   #include <omp.h>
 #endif
+#if defined(__linux__)
+  #include <unistd.h>
+  #include <sys/syscall.h>
+#endif
 #include <ippcore.h>
+#include <ipps.h>
 using namespace std;
 
 
@@ -139,6 +147,17 @@ void initKernel(int debugLevel)
         cout << " Config: " << 8 * sizeof(ii) << "bit MKL addressing, " << mkl_get_max_threads() << " MKL threads, ";
 #if defined(_OPENMP)
         cout << omp_get_max_threads() << " OpenMP threads";
+  #if _OPENMP >= 201307
+        // the binding the runtime actually applied, which can only be set from outside with OMP_PROC_BIND/OMP_PLACES
+        switch (omp_get_proc_bind())
+        {
+            case omp_proc_bind_false: break;
+            case omp_proc_bind_true: cout << " bound"; break;
+            case omp_proc_bind_master: cout << " bound master"; break;
+            case omp_proc_bind_close: cout << " bound close"; break;
+            case omp_proc_bind_spread: cout << " bound spread"; break;
+        }
+  #endif
 #else
         cout << "non-OpenMP build";
 #endif
@@ -186,4 +205,176 @@ string getTimeStamp()
 }
 
 
-}
\ No newline at end of file
+void checkIndex(li size, const string& what)
+{
+    if (size > (li)numeric_limits<ii>::max())
+    {
+        ostringstream oss;
+        oss << "ERROR: " << what << " needs " << size << " elements, which overflows " << 8 * sizeof(ii) << " bit addressing.";
+        oss << " Rebuild seaMass configured with -DSEAMASS_ILP64=ON for 64 bit addressing.";
+        throw runtime_error(oss.str());
+    }
+}
+
+
+void copyIndices(const ii* src, ii* dst, li length)
+{
+    ippChunksParallel(length, [&](li offset, int chunk)
+    {
+#ifdef MKL_ILP64
+        ippsCopy_64s((const Ipp64s*)&src[offset], (Ipp64s*)&dst[offset], chunk);
+#else
+        ippsCopy_32s(&src[offset], &dst[offset], chunk);
+#endif
+    });
+}
+
+
+void copyValues(const fp* src, fp* dst, li length)
+{
+    ippChunksParallel(length, [&](li offset, int chunk)
+    {
+        ippsCopy_32f(&src[offset], &dst[offset], chunk);
+    });
+}
+
+
+double getLocalFraction(const void* p, li bytes)
+{
+#if defined(__linux__) && defined(SYS_move_pages) && defined(SYS_getcpu) && defined(_OPENMP)
+    if (!p || bytes <= 0)
+        return -1.0;
+
+    uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    li local = 0;
+    li total = 0;
+
+    #pragma omp parallel reduction(+:local,total)
+    {
+        int t = omp_get_thread_num();
+        int threads = omp_get_num_threads();
+        uintptr_t begin = uintptr_t(p) + uintptr_t(bytes * t / threads);
+        uintptr_t end = uintptr_t(p) + uintptr_t(bytes * (t + 1) / threads);
+
+        unsigned cpu, node;
+        if (begin < end && syscall(SYS_getcpu, &cpu, &node, 0) == 0)
+        {
+            // with no target nodes, move_pages just reports the node each page is on
+            vector<void*> pages;
+            for (uintptr_t page = begin & ~(pageSize - 1); page < end; page += pageSize)
+                pages.push_back(reinterpret_cast<void*>(page));
+            vector<int> nodes(pages.size());
+
+            if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), 0, nodes.data(), 0) == 0)
+            {
+                for (size_t i = 0; i < nodes.size(); i++)
+                {
+                    if (nodes[i] >= 0)
+                    {
+                        total++;
+                        if (nodes[i] == int(node))
+                            local++;
+                    }
+                }
+            }
+        }
+    }
+
+    return total > 0 ? local / double(total) : -1.0;
+#else
+    return -1.0;
+#endif
+}
+
+
+ii prefixSum(ii* xs, ii length)
+{
+#if defined(_OPENMP)
+    // each thread sums its own block, then offsets it by the totals of the blocks before it
+    vector<ii> sums;
+    #pragma omp parallel
+    {
+        int t = omp_get_thread_num();
+        int threads = omp_get_num_threads();
+
+        #pragma omp single
+        sums.assign(threads + 1, 0);
+
+        ii begin = ii((li)length * t / threads);
+        ii end = ii((li)length * (t + 1) / threads);
+
+        ii sum = 0;
+        for (ii i = begin; i < end; i++)
+            sum += xs[i];
+        sums[t + 1] = sum;
+
+        #pragma omp barrier
+        #pragma omp single
+        for (int k = 0; k < threads; k++)
+            sums[k + 1] += sums[k];
+
+        ii offset = sums[t];
+        for (ii i = begin; i < end; i++)
+        {
+            ii x = xs[i];
+            xs[i] = offset;
+            offset += x;
+        }
+    }
+
+    return sums.back();
+#else
+    ii offset = 0;
+    for (ii i = 0; i < length; i++)
+    {
+        ii x = xs[i];
+        xs[i] = offset;
+        offset += x;
+    }
+
+    return offset;
+#endif
+}
+
+
+template<typename T>
+ii compactRows(ii m, ii* is0, ii*& js, T*& vs, ii* lengths)
+{
+    ii oldNnz = is0[m];
+
+    lengths[m] = 0;
+    ii nnz = prefixSum(lengths, m + 1);
+
+    // rows only ever move towards the front, so shifting them in order never overwrites one still to be moved. This is
+    // serial: a row's new place can overlap rows before it that have not moved yet, so a parallel shift would need
+    // scratch space proportional to what was pruned, and the memmoves are bound by memory bandwidth anyway. The row
+    // counts above are a parallel prefix sum, and callers drop the pruned non-zeros within each row in parallel first
+    for (ii i = 0; i < m; i++)
+    {
+        ii length = lengths[i + 1] - lengths[i];
+        if (length > 0 && lengths[i] != is0[i])
+        {
+            if (js)
+                memmove(&js[lengths[i]], &js[is0[i]], sizeof(ii) * length);
+            if (vs)
+                memmove(&vs[lengths[i]], &vs[is0[i]], sizeof(T) * length);
+        }
+    }
+    copyIndices(lengths, is0, m + 1);
+
+    if (nnz > 0 && nnz <= oldNnz / 2)
+    {
+        if (js)
+            js = static_cast<ii*>(mkl_realloc(js, sizeof(ii) * nnz));
+        if (vs)
+            vs = static_cast<T*>(mkl_realloc(vs, sizeof(T) * nnz));
+    }
+
+    return nnz;
+}
+
+template ii compactRows(ii m, ii* is0, ii*& js, fp*& vs, ii* lengths);
+template ii compactRows(ii m, ii* is0, ii*& js, unsigned short*& vs, ii* lengths);
+
+
+}
@@ -26,17 +26,78 @@
 
 #include "types.hpp"
 #include "MatrixSparse.hpp"
+#include "MatrixSparseBatch.hpp"
+#include <algorithm>
+#include <limits>
 #include <string>
+#if defined(_OPENMP)
+  #include <omp.h>
+#endif
 
 
 namespace kernel
 {
+    // OpenMP thread placement is read when the runtime loads, so it is left to the caller's OMP_PROC_BIND/OMP_PLACES
     void initKernel(int debugLevel);
     li getId();
 
     double getElapsedTime();
     li getUsedMemory();
     std::string getTimeStamp();
+
+    // 32 bit addressing fails fast if 'size' elements would overflow ii (configure with SEAMASS_ILP64=ON for 64 bit)
+    void checkIndex(li size, const std::string& what);
+
+    // IPP lengths are always 32 bit, so arrays that can be longer (e.g. nnz with 64 bit addressing) are done in chunks
+    template<typename Function>
+    void ippChunks(li length, Function f) // calls f(offset, chunkLength) for each chunk
+    {
+        for (li offset = 0; offset < length; offset += std::numeric_limits<int>::max())
+            f(offset, (int)std::min(length - offset, (li)std::numeric_limits<int>::max()));
+    }
+
+    // as ippChunks, but long arrays are first split into one contiguous part per thread, the same partition a static
+    // parallel loop over the elements gives. On NUMA systems, freshly allocated memory written this way is then placed
+    // on the nodes of the threads that go on to process it
+    template<typename Function>
+    void ippChunksParallel(li length, Function f)
+    {
+#if defined(_OPENMP)
+        if (length >= 65536 && omp_get_max_threads() > 1)
+        {
+            #pragma omp parallel
+            {
+                int t = omp_get_thread_num();
+                int threads = omp_get_num_threads();
+                li begin = length * t / threads;
+                li end = length * (t + 1) / threads;
+
+                ippChunks(end - begin, [&](li offset, int chunk)
+                {
+                    f(begin + offset, chunk);
+                });
+            }
+
+            return;
+        }
+#endif
+        ippChunks(length, f);
+    }
+
+    void copyIndices(const ii* src, ii* dst, li length); // ippsCopy for ii of either width
+    void copyValues(const fp* src, fp* dst, li length); // ippsCopy for fp
+
+    // fraction of the pages of [p, p + bytes) that are on the NUMA node of the thread a static partition gives them to,
+    // or -1 if this cannot be determined on this platform
+    double getLocalFraction(const void* p, li bytes);
+
+    ii prefixSum(ii* xs, ii length); // parallel exclusive prefix sum in place, returns the total
+
+    // shifts the first lengths[i] non-zeros of each CSR row down to close the gaps, rewriting is0 (m + 1 long) and
+    // consuming lengths (also m + 1 long). js and vs can be 0, and are only reallocated if at least half their memory
+    // is reclaimed. Values can be fp or 16 bit
+    template<typename T>
+    ii compactRows(ii m, ii* is0, ii*& js, T*& vs, ii* lengths); // returns the new nnz
 }
 
 
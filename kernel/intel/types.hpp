@@ -24,7 +24,7 @@
 #define SEAMASS_KERNEL_INTEL_TYPES_HPP
 
 
-//#define MKL_ILP64 // use 64 bit addressing (comment out for 32 bit)
+// MKL_ILP64 (64 bit addressing) is defined for all targets when configured with -DSEAMASS_ILP64=ON
 #include <mkl.h>
 #include <mkl_spblas.h>
 